@@ -0,0 +1,425 @@
+//
+//    CPU-only micro and macro benchmarks (no GL context needed)
+//    Usage: A5_bench RESOURCE_DIR [--json FILE] [--filter SUBSTRING]
+//
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <functional>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <stdio.h>
+#include <string.h>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include "Bvh.h"
+#include "Easing.h"
+#include "JobSystem.h"
+#include "MatrixStack.h"
+#include "Shape.h"
+#include "Spline.h"
+#include "tiny_obj_loader.h"
+
+using namespace std;
+
+struct Result
+{
+	string name;
+	long iterations;
+	double nsPerOp;
+};
+
+vector<Result> results;
+string filter;
+volatile float sink; // keeps the benchmarked work from being optimized away
+
+// Runs op in batches until at least minSeconds have elapsed
+static void bench(const string &name, const function<void()> &op, double minSeconds = 0.25)
+{
+	if(!filter.empty() && name.find(filter) == string::npos) {
+		return;
+	}
+	op(); // warm up
+	long iterations = 0;
+	long batch = 1;
+	double elapsed = 0.0;
+	while(elapsed < minSeconds) {
+		auto start = chrono::steady_clock::now();
+		for(long i = 0; i < batch; ++i) {
+			op();
+		}
+		elapsed += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		iterations += batch;
+		batch *= 2;
+	}
+	Result r;
+	r.name = name;
+	r.iterations = iterations;
+	r.nsPerOp = 1e9*elapsed/iterations;
+	results.push_back(r);
+	printf("%-40s %12ld %14.1f ns/op\n", name.c_str(), iterations, r.nsPerOp);
+}
+
+static bool writeJSON(const string &fileName)
+{
+	FILE *fp = fopen(fileName.c_str(), "w");
+	if(fp == NULL) {
+		cerr << "Cannot write " << fileName << endl;
+		return false;
+	}
+	fprintf(fp, "{\n  \"benchmarks\": [\n");
+	for(size_t i = 0; i < results.size(); ++i) {
+		fprintf(fp, "    {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.3f}%s\n",
+		        results[i].name.c_str(), results[i].iterations, results[i].nsPerOp,
+		        i + 1 < results.size() ? "," : "");
+	}
+	fprintf(fp, "  ]\n}\n");
+	fclose(fp);
+	return true;
+}
+
+// Same path and keyframe rotations as the application
+static void makeScene(Spline &spline, vector<glm::quat> &rots)
+{
+	vector<glm::vec3> cps;
+	cps.push_back(glm::vec3(0, 0, 0));
+	cps.push_back(glm::vec3(-2, 3, -3));
+	cps.push_back(glm::vec3(-1.5, 6, -3));
+	cps.push_back(glm::vec3(3, 1, 3));
+	cps.push_back(glm::vec3(-6, 3, -3));
+	cps.push_back(cps[0]);
+	cps.push_back(cps[1]);
+	cps.push_back(cps[2]);
+	glm::vec3 axes[5] = { glm::vec3(0, 1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1) };
+	for(int i = 0; i < 5; ++i) {
+		rots.push_back(glm::angleAxis(glm::radians(90.0f), axes[i]));
+	}
+	rots.push_back(rots[0]);
+	rots.push_back(rots[1]);
+	rots.push_back(rots[2]);
+	for(size_t i = 0; i < cps.size(); ++i) {
+		spline.addControlPoint(cps[i]);
+	}
+	spline.buildTable();
+}
+
+// The transforms Helicopter::draw() composes for one helicopter
+static void helicopterTransforms(MatrixStack &M, const glm::mat4 &E, float theta)
+{
+	M.pushMatrix();
+	M.multMatrix(E);
+	M.pushMatrix();
+	M.translate(0.0f, 0.4819f, 0.0f);
+	M.rotate(theta, 0, 1, 0);
+	M.translate(0.0f, -0.4819f, 0.0f);
+	sink = M.topMatrix()[3][0];
+	M.popMatrix();
+	M.pushMatrix();
+	M.translate(0.6228f, 0.1179f, 0.1365f);
+	M.rotate(-theta, 0, 0, 1);
+	M.translate(-0.6228f, -0.1179f, -0.1365f);
+	sink = M.topMatrix()[3][0];
+	M.popMatrix();
+	M.popMatrix();
+}
+
+// Synthetic fleet: every helicopter follows the path with its own offset and
+// speed. Writes the body and both propeller transforms of [begin, end).
+static void fleetPoses(const Spline &spline, const vector<glm::quat> &rots, float t, int begin, int end, vector<glm::mat4> &out)
+{
+	const float smax = spline.getLength();
+	MatrixStack M;
+	for(int i = begin; i < end; ++i) {
+		float s = fmod(t*(0.1f + 0.0001f*(i % 1000)) + 0.618f*i, 1.0f)*smax;
+		float u = spline.s2u(s);
+		glm::mat4 H = glm::toMat4(spline.rotation(rots, u));
+		H[3] = glm::vec4(spline.position(u), 1.0f);
+		M.pushMatrix();
+		M.multMatrix(H);
+		out[3*i] = M.topMatrix();
+		M.pushMatrix();
+		M.translate(0.0f, 0.4819f, 0.0f);
+		M.rotate(t, 0, 1, 0);
+		M.translate(0.0f, -0.4819f, 0.0f);
+		out[3*i + 1] = M.topMatrix();
+		M.popMatrix();
+		M.pushMatrix();
+		M.translate(0.6228f, 0.1179f, 0.1365f);
+		M.rotate(-t, 0, 0, 1);
+		M.translate(-0.6228f, -0.1179f, -0.1365f);
+		out[3*i + 2] = M.topMatrix();
+		M.popMatrix();
+		M.popMatrix();
+	}
+}
+
+// Writes a sphere with slices x stacks quads (two triangles each), its
+// radius rippled so the triangles are not all alike
+static bool writeSphere(const string &fileName, int slices, int stacks)
+{
+	FILE *fp = fopen(fileName.c_str(), "w");
+	if(fp == NULL) {
+		cerr << "Cannot write " << fileName << endl;
+		return false;
+	}
+	for(int j = 0; j <= stacks; ++j) {
+		float theta = (float)M_PI*j/stacks;
+		for(int i = 0; i <= slices; ++i) {
+			float phi = 2.0f*(float)M_PI*i/slices;
+			float r = 1.0f + 0.05f*sin(23.0f*phi)*sin(17.0f*theta);
+			fprintf(fp, "v %f %f %f\n", r*sin(theta)*cos(phi), r*cos(theta), r*sin(theta)*sin(phi));
+		}
+	}
+	for(int j = 0; j < stacks; ++j) {
+		for(int i = 0; i < slices; ++i) {
+			// OBJ indices start at 1
+			int a = j*(slices + 1) + i + 1;
+			int b = a + slices + 1;
+			fprintf(fp, "f %d %d %d\nf %d %d %d\n", a, b, a + 1, a + 1, b, b + 1);
+		}
+	}
+	fclose(fp);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	if(argc < 2) {
+		cout << "Usage: " << argv[0] << " RESOURCE_DIR [--json FILE] [--filter SUBSTRING]" << endl;
+		return 0;
+	}
+	string RESOURCE_DIR = argv[1] + string("/");
+	string jsonName;
+	for(int i = 2; i < argc; ++i) {
+		if(strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+			jsonName = argv[++i];
+		} else if(strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+			filter = argv[++i];
+		} else {
+			cerr << "Unknown option " << argv[i] << endl;
+			return -1;
+		}
+	}
+	
+	Spline spline;
+	vector<glm::quat> rots;
+	makeScene(spline, rots);
+	const int nsegs = spline.getSegmentCount();
+	const float smax = spline.getLength();
+	
+	// Spline evaluation
+	float u = 0.0f;
+	bench("spline/position", [&]() {
+		u += 0.001f;
+		if(u >= nsegs) u = 0.0f;
+		sink = spline.position(u).x;
+	});
+	bench("spline/rotation (quaternion Catmull-Rom)", [&]() {
+		u += 0.001f;
+		if(u >= nsegs) u = 0.0f;
+		sink = spline.rotation(rots, u).w;
+	});
+	bench("spline/buildTable", [&]() {
+		spline.buildTable();
+		sink = spline.getLength();
+	});
+	float s = 0.0f;
+	bench("spline/s2u", [&]() {
+		s += 0.001f*smax;
+		if(s >= smax) s = 0.0f;
+		sink = spline.s2u(s);
+	});
+	
+	// Time to distance: the easing table against the polynomial it replaced
+	Easing easing = Easing::preset(Easing::EASE_IN_OUT);
+	float x = 0.0f;
+	bench("easing/evaluate (table)", [&]() {
+		x += 0.001f;
+		if(x >= 1.0f) x = 0.0f;
+		sink = easing.evaluate(x);
+	});
+	bench("easing/polynomial (previous 'q')", [&]() {
+		x += 0.001f;
+		if(x >= 1.0f) x = 0.0f;
+		sink = 117.03f*x*x*x*x*x - 335.24f*x*x*x*x + 338.13f*x*x*x - 140.76f*x*x + 20.838f*x;
+	});
+	
+	// MatrixStack
+	MatrixStack M;
+	glm::mat4 E = glm::toMat4(rots[1]);
+	E[3] = glm::vec4(1.0f, 2.0f, 3.0f, 1.0f);
+	bench("MatrixStack/translate", [&]() {
+		M.pushMatrix();
+		M.translate(0.1f, 0.2f, 0.3f);
+		sink = M.topMatrix()[3][0];
+		M.popMatrix();
+	});
+	bench("MatrixStack/rotate", [&]() {
+		M.pushMatrix();
+		M.rotate(0.3f, 0.0f, 1.0f, 0.0f);
+		sink = M.topMatrix()[0][0];
+		M.popMatrix();
+	});
+	bench("MatrixStack/scale", [&]() {
+		M.pushMatrix();
+		M.scale(0.5f, 2.0f, 1.5f);
+		sink = M.topMatrix()[0][0];
+		M.popMatrix();
+	});
+	bench("MatrixStack/multMatrix", [&]() {
+		M.pushMatrix();
+		M.multMatrix(E);
+		sink = M.topMatrix()[0][0];
+		M.popMatrix();
+	});
+	
+	// Mesh loading
+	const char *meshes[] = { "bunny.obj", "helicopter_body1.obj", "helicopter_body2.obj", "helicopter_prop1.obj", "helicopter_prop2.obj" };
+	for(int i = 0; i < 5; ++i) {
+		string meshName = RESOURCE_DIR + meshes[i];
+		bench(string("tinyobj::LoadObj/") + meshes[i], [&]() {
+			tinyobj::attrib_t attrib;
+			vector<tinyobj::shape_t> shapes;
+			vector<tinyobj::material_t> materials;
+			string errStr;
+			tinyobj::LoadObj(&attrib, &shapes, &materials, &errStr, meshName.c_str());
+			sink = (float)attrib.vertices.size();
+		});
+		bench(string("Shape::loadMesh/") + meshes[i], [&]() {
+			Shape shape;
+			shape.loadMesh(meshName);
+		});
+	}
+	
+	// Picking: triangle BVH build and ray casts through the bunny's bounds
+	// and through a million-triangle mesh, then a BVH over 4096
+	// keyframe-sized boxes
+	{
+		Shape bunny;
+		bunny.loadMesh(RESOURCE_DIR + "bunny.obj");
+		bench("Shape::buildBvh/bunny.obj", [&]() {
+			bunny.buildBvh();
+		});
+		shared_ptr<const Bvh> bvh = bunny.getBvh();
+		if(bvh && !bvh->empty()) {
+			const glm::vec3 lo = bvh->getMin();
+			const glm::vec3 hi = bvh->getMax();
+			mt19937 rng(1);
+			uniform_real_distribution<float> unit(0.0f, 1.0f);
+			bench("Shape::intersect/bunny.obj (random rays)", [&]() {
+				glm::vec3 target = lo + (hi - lo)*glm::vec3(unit(rng), unit(rng), unit(rng));
+				glm::vec3 origin = 0.5f*(lo + hi) + 2.0f*glm::length(hi - lo)*glm::normalize(glm::vec3(unit(rng) - 0.5f, unit(rng) - 0.5f, unit(rng) - 0.5f));
+				float tmax = 1e30f;
+				sink = bunny.intersect(origin, target - origin, tmax) ? tmax : 0.0f;
+			});
+		}
+		// A million triangles: a bumpy sphere written out as an OBJ, so the
+		// mesh goes through the same loading as the real ones
+		string bigName = "bench_sphere_1m.obj";
+		if(writeSphere(bigName, 1000, 500)) {
+			Shape big;
+			big.loadMesh(bigName);
+			remove(bigName.c_str());
+			char name[64];
+			snprintf(name, sizeof(name), "Shape::buildBvh/sphere (%d triangles)", big.getVertexCount()/3);
+			bench(name, [&]() {
+				big.buildBvh();
+			});
+			shared_ptr<const Bvh> bigBvh = big.getBvh();
+			if(bigBvh && !bigBvh->empty()) {
+				const glm::vec3 lo = bigBvh->getMin();
+				const glm::vec3 hi = bigBvh->getMax();
+				mt19937 rng(3);
+				uniform_real_distribution<float> unit(0.0f, 1.0f);
+				snprintf(name, sizeof(name), "Shape::intersect/sphere (%d triangles)", big.getVertexCount()/3);
+				bench(name, [&]() {
+					glm::vec3 target = lo + (hi - lo)*glm::vec3(unit(rng), unit(rng), unit(rng));
+					glm::vec3 origin = 0.5f*(lo + hi) + 2.0f*glm::length(hi - lo)*glm::normalize(glm::vec3(unit(rng) - 0.5f, unit(rng) - 0.5f, unit(rng) - 0.5f));
+					float tmax = 1e30f;
+					sink = big.intersect(origin, target - origin, tmax) ? tmax : 0.0f;
+				});
+			}
+		}
+		const int nboxes = 4096;
+		vector<glm::vec3> mins(nboxes), maxs(nboxes);
+		mt19937 rng(2);
+		uniform_real_distribution<float> unit(-50.0f, 50.0f);
+		for(int i = 0; i < nboxes; ++i) {
+			glm::vec3 c(unit(rng), unit(rng), unit(rng));
+			mins[i] = c - glm::vec3(1.0f);
+			maxs[i] = c + glm::vec3(1.0f);
+		}
+		Bvh boxes;
+		bench("Bvh::build (4096 boxes)", [&]() {
+			boxes.build(mins, maxs);
+		});
+		bench("Bvh::intersect (4096 boxes)", [&]() {
+			glm::vec3 origin(unit(rng), unit(rng), -100.0f);
+			float tmax = 1e30f;
+			int hits = 0;
+			boxes.intersect(origin, glm::vec3(0.0f, 0.0f, 1.0f), tmax, [&](int i, float &t) {
+				++hits;
+			});
+			sink = (float)hits;
+		});
+	}
+	
+	// Macro: the CPU side of one frame of the animation (path, helicopter
+	// and the eight keyframe helicopters), without any GL calls
+	float t = 0.0f;
+	bench("frame/animation (1 + 8 keyframes)", [&]() {
+		t += 1.0f/60.0f;
+		float tNorm = fmod(t, 10.0f)/11.0f;
+		float uf = spline.s2u(smax*tNorm);
+		glm::mat4 H = glm::toMat4(spline.rotation(rots, uf));
+		glm::vec3 p = spline.position(uf);
+		H[3] = glm::vec4(p.x, p.y, p.z, 1.0f);
+		helicopterTransforms(M, H, t);
+		const vector<glm::vec3> &cps = spline.getControlPoints();
+		for(size_t k = 0; k < cps.size(); ++k) {
+			glm::mat4 K = glm::toMat4(rots[k]);
+			K[3] = glm::vec4(cps[k], 1.0f);
+			helicopterTransforms(M, K, t);
+		}
+	});
+	
+	// Job system scaling: the same fleet update on 1, 2, 4, ... threads
+	const int fleetSize = 10000;
+	vector<glm::mat4> fleet(3*fleetSize);
+	int maxThreads = max(1, (int)thread::hardware_concurrency());
+	double single = 0.0;
+	for(int threads = 1; ; threads = min(2*threads, maxThreads)) {
+		JobSystem jobs(threads);
+		char name[64];
+		snprintf(name, sizeof(name), "jobs/fleet %d (%d threads)", fleetSize, threads);
+		size_t before = results.size();
+		float tf = 0.0f;
+		bench(name, [&]() {
+			tf += 1.0f/60.0f;
+			jobs.parallelFor(fleetSize, 64, [&](int worker, int begin, int end) {
+				fleetPoses(spline, rots, tf, begin, end, fleet);
+			});
+		});
+		if(results.size() > before) {
+			if(threads == 1) {
+				single = results.back().nsPerOp;
+			} else if(single > 0.0) {
+				printf("%-40s %12s %14.2fx\n", "", "speedup", single/results.back().nsPerOp);
+			}
+		}
+		if(threads == maxThreads) {
+			break;
+		}
+	}
+	
+	if(!jsonName.empty() && !writeJSON(jsonName)) {
+		return -1;
+	}
+	return 0;
+}
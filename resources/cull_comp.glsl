@@ -0,0 +1,41 @@
+#version 430
+layout(local_size_x = 256) in;
+
+struct Instance
+{
+	vec4 pos; // world position
+	vec4 rot; // unit quaternion (x, y, z, w)
+};
+layout(std430, binding = 0) readonly buffer Instances
+{
+	Instance instances[];
+};
+layout(std430, binding = 1) writeonly buffer Visible
+{
+	Instance visible[];
+};
+// DrawArraysIndirectCommand: count, instanceCount, first, baseInstance
+layout(std430, binding = 2) buffer Commands
+{
+	uint commands[];
+};
+uniform vec4 uPlanes[6]; // inward facing, xyz normalized
+uniform float uRadius;   // bounding sphere of one instance
+uniform uint uCount;
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+	if(i >= uCount) {
+		return;
+	}
+	vec3 p = instances[i].pos.xyz;
+	for(int k = 0; k < 6; ++k) {
+		if(dot(uPlanes[k].xyz, p) + uPlanes[k].w < -uRadius) {
+			return;
+		}
+	}
+	// The first command's instanceCount is the visible count
+	uint slot = atomicAdd(commands[1], 1u);
+	visible[slot] = instances[i];
+}
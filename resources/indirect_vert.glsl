@@ -0,0 +1,18 @@
+#version 120
+#extension GL_ARB_uniform_buffer_object : require
+attribute vec4 aPos;
+attribute vec3 aNor;
+attribute mat4 aM; // per draw, selected by the command's baseInstance
+layout(std140) uniform Camera
+{
+	mat4 P;
+	mat4 V;
+};
+varying vec3 vNor;
+
+void main()
+{
+	mat4 MV = V * aM;
+	gl_Position = P * MV * aPos;
+	vNor = (MV * vec4(aNor, 0.0)).xyz;
+}
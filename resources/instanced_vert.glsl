@@ -0,0 +1,29 @@
+#version 120
+#extension GL_ARB_uniform_buffer_object : require
+attribute vec4 aPos;
+attribute vec3 aNor;
+attribute vec4 aInstPos; // per instance: world position
+attribute vec4 aInstRot; // per instance: unit quaternion (x, y, z, w)
+layout(std140) uniform Camera
+{
+	mat4 P;
+	mat4 V;
+};
+layout(std140) uniform Object
+{
+	mat4 M; // part transform, shared by all instances
+};
+varying vec3 vNor;
+
+vec3 rotate(vec4 q, vec3 v)
+{
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main()
+{
+	vec3 p = rotate(aInstRot, (M * aPos).xyz) + aInstPos.xyz;
+	vec3 n = rotate(aInstRot, (M * vec4(aNor, 0.0)).xyz);
+	gl_Position = P * V * vec4(p, 1.0);
+	vNor = (V * vec4(n, 0.0)).xyz;
+}
@@ -1,12 +1,21 @@
 #version 120
+#extension GL_ARB_uniform_buffer_object : require
 attribute vec4 aPos;
 attribute vec3 aNor;
-uniform mat4 P;
-uniform mat4 MV;
+layout(std140) uniform Camera
+{
+	mat4 P;
+	mat4 V;
+};
+layout(std140) uniform Object
+{
+	mat4 M;
+};
 varying vec3 vNor;
 
 void main()
 {
+	mat4 MV = V * M;
 	gl_Position = P * MV * aPos;
 	vNor = (MV * vec4(aNor, 0.0)).xyz;
 }
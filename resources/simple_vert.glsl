@@ -1,11 +1,19 @@
 #version 120
+#extension GL_ARB_uniform_buffer_object : require
 
-uniform mat4 P;
-uniform mat4 MV;
+layout(std140) uniform Camera
+{
+	mat4 P;
+	mat4 V;
+};
+layout(std140) uniform Object
+{
+	mat4 M;
+};
 varying vec3 fragColor;
 
 void main()
 {
-	gl_Position = P * MV * gl_Vertex;
+	gl_Position = P * V * M * gl_Vertex;
 	fragColor = gl_Color.rgb;
 }
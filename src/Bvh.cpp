@@ -0,0 +1,154 @@
+#include "Bvh.h"
+
+#include <cfloat>
+
+#include "Trace.h"
+
+using namespace std;
+
+static float area(const glm::vec3 &min, const glm::vec3 &max)
+{
+	glm::vec3 d = max - min;
+	return d.x*d.y + d.y*d.z + d.z*d.x;
+}
+
+Bvh::Bvh()
+{
+	
+}
+
+Bvh::~Bvh()
+{
+	
+}
+
+void Bvh::build(const vector<glm::vec3> &mins, const vector<glm::vec3> &maxs)
+{
+	TraceScope trace("Bvh::build");
+	nodes.clear();
+	indices.clear();
+	if(mins.empty()) {
+		return;
+	}
+	vector<Ref> refs(mins.size());
+	for(size_t i = 0; i < mins.size(); ++i) {
+		refs[i].min = mins[i];
+		refs[i].max = maxs[i];
+		refs[i].centroid = 0.5f*(mins[i] + maxs[i]);
+		refs[i].index = (int)i;
+	}
+	nodes.reserve(2*mins.size()/LEAF_SIZE + 1);
+	nodes.push_back(Node());
+	split(0, 0, (int)refs.size(), 0, refs);
+	indices.resize(refs.size());
+	for(size_t i = 0; i < refs.size(); ++i) {
+		indices[i] = refs[i].index;
+	}
+}
+
+void Bvh::split(int node, int begin, int end, int depth, vector<Ref> &refs)
+{
+	// Bounds of the boxes and of their centroids
+	glm::vec3 bmin = refs[begin].min;
+	glm::vec3 bmax = refs[begin].max;
+	glm::vec3 cmin = refs[begin].centroid;
+	glm::vec3 cmax = cmin;
+	for(int i = begin + 1; i < end; ++i) {
+		bmin = glm::min(bmin, refs[i].min);
+		bmax = glm::max(bmax, refs[i].max);
+		cmin = glm::min(cmin, refs[i].centroid);
+		cmax = glm::max(cmax, refs[i].centroid);
+	}
+	nodes[node].min = bmin;
+	nodes[node].max = bmax;
+	nodes[node].index = begin;
+	nodes[node].count = end - begin;
+	
+	int count = end - begin;
+	if(count <= LEAF_SIZE || depth >= MAX_DEPTH) {
+		return;
+	}
+	// Split along the longest axis of the centroids; if they all coincide,
+	// no plane separates them
+	glm::vec3 extent = cmax - cmin;
+	int axis = 0;
+	if(extent.y > extent[axis]) {
+		axis = 1;
+	}
+	if(extent.z > extent[axis]) {
+		axis = 2;
+	}
+	if(extent[axis] <= 0.0f) {
+		return;
+	}
+	
+	// Bin the centroids, then sweep the planes between bins for the lowest
+	// cost: 1 traversal step plus the expected primitive tests
+	int binCount[BINS] = { 0 };
+	glm::vec3 binMin[BINS];
+	glm::vec3 binMax[BINS];
+	const float scale = BINS/extent[axis];
+	for(int i = begin; i < end; ++i) {
+		const Ref &r = refs[i];
+		int b = min((int)((r.centroid[axis] - cmin[axis])*scale), BINS - 1);
+		if(binCount[b]++ == 0) {
+			binMin[b] = r.min;
+			binMax[b] = r.max;
+		} else {
+			binMin[b] = glm::min(binMin[b], r.min);
+			binMax[b] = glm::max(binMax[b], r.max);
+		}
+	}
+	// Right side areas and counts for the planes after bin i
+	float rightArea[BINS];
+	int rightCount[BINS];
+	glm::vec3 rmin, rmax;
+	int n = 0;
+	for(int i = BINS - 1; i > 0; --i) {
+		if(binCount[i] > 0) {
+			rmin = n == 0 ? binMin[i] : glm::min(rmin, binMin[i]);
+			rmax = n == 0 ? binMax[i] : glm::max(rmax, binMax[i]);
+			n += binCount[i];
+		}
+		rightCount[i - 1] = n;
+		rightArea[i - 1] = n > 0 ? area(rmin, rmax) : 0.0f;
+	}
+	float bestCost = FLT_MAX;
+	int bestSplit = -1;
+	glm::vec3 lmin, lmax;
+	n = 0;
+	for(int i = 0; i < BINS - 1; ++i) {
+		if(binCount[i] > 0) {
+			lmin = n == 0 ? binMin[i] : glm::min(lmin, binMin[i]);
+			lmax = n == 0 ? binMax[i] : glm::max(lmax, binMax[i]);
+			n += binCount[i];
+		}
+		if(n == 0 || rightCount[i] == 0) {
+			continue;
+		}
+		float cost = n*area(lmin, lmax) + rightCount[i]*rightArea[i];
+		if(cost < bestCost) {
+			bestCost = cost;
+			bestSplit = i;
+		}
+	}
+	float parentArea = area(bmin, bmax);
+	if(bestSplit < 0 || (count <= MAX_LEAF && parentArea > 0.0f && 1.0f + bestCost/parentArea >= count)) {
+		return;
+	}
+	
+	Ref *first = &refs[0];
+	int mid = (int)(partition(first + begin, first + end, [&](const Ref &r) {
+		return min((int)((r.centroid[axis] - cmin[axis])*scale), BINS - 1) <= bestSplit;
+	}) - first);
+	
+	// First child right after this node, second after the first's subtree
+	nodes[node].count = 0;
+	int left = (int)nodes.size();
+	nodes.push_back(Node());
+	split(left, begin, mid, depth + 1, refs);
+	int right = (int)nodes.size();
+	nodes.push_back(Node());
+	nodes[node].index = right;
+	split(right, mid, end, depth + 1, refs);
+}
@@ -0,0 +1,141 @@
+#pragma  once
+#ifndef __Bvh__
+#define __Bvh__
+
+#include <algorithm>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+/**
+ * Bounding volume hierarchy over axis-aligned boxes, for ray casting
+ * - build() takes one box per primitive (triangles, helicopters, ...) and
+ *   splits them top-down with a binned surface area heuristic.
+ * - Nodes are 32 bytes in one array, in depth-first order: an inner node's
+ *   first child follows it and the second is at its index.
+ * - intersect() walks the tree front to back and hands the primitives to a
+ *   callback, which tests them and shortens the ray on a hit; subtrees
+ *   behind the closest hit so far are skipped.
+ */
+class Bvh
+{
+public:
+	enum {
+		LEAF_SIZE = 4,  // primitives per leaf, unless splitting costs more
+		MAX_LEAF = 16,  // above this a leaf is always split
+		BINS = 16,
+		MAX_DEPTH = 60  // intersect()'s stack is sized for this
+	};
+	
+	struct Node
+	{
+		glm::vec3 min;
+		int index; // inner: second child; leaf: first entry in getIndices()
+		glm::vec3 max;
+		int count; // 0 for inner nodes
+	};
+	
+	Bvh();
+	virtual ~Bvh();
+	
+	void build(const std::vector<glm::vec3> &mins, const std::vector<glm::vec3> &maxs);
+	bool empty() const { return nodes.empty(); }
+	const glm::vec3 &getMin() const { return nodes[0].min; }
+	const glm::vec3 &getMax() const { return nodes[0].max; }
+	const std::vector<Node> &getNodes() const { return nodes; }
+	const std::vector<int> &getIndices() const { return indices; }
+	
+	// Calls visit(primitive, tmax) for the primitives whose boxes the ray
+	// origin + t*dir, 0 <= t < tmax, goes through, nearer boxes first. On a
+	// hit, visit() lowers tmax to the hit's t.
+	template <class F>
+	void intersect(const glm::vec3 &origin, const glm::vec3 &dir, float &tmax, F visit) const;
+	
+	// Slab test; tnear is where the ray enters the box
+	static bool intersectBox(const glm::vec3 &min, const glm::vec3 &max, const glm::vec3 &origin,
+	                         const glm::vec3 &invDir, float tmax, float &tnear)
+	{
+		glm::vec3 t0 = (min - origin)*invDir;
+		glm::vec3 t1 = (max - origin)*invDir;
+		glm::vec3 tmin = glm::min(t0, t1);
+		glm::vec3 tmaxs = glm::max(t0, t1);
+		tnear = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+		float tfar = std::min(std::min(tmaxs.x, tmaxs.y), std::min(tmaxs.z, tmax));
+		return tnear <= tfar;
+	}
+	
+private:
+	// A primitive's box during build(); sorted in place, so the splits
+	// stream through memory
+	struct Ref
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+		glm::vec3 centroid;
+		int index;
+	};
+	
+	void split(int node, int begin, int end, int depth, std::vector<Ref> &refs);
+	
+	std::vector<Node> nodes;
+	std::vector<int> indices; // primitives, grouped by leaf
+};
+
+template <class F>
+void Bvh::intersect(const glm::vec3 &origin, const glm::vec3 &dir, float &tmax, F visit) const
+{
+	if(nodes.empty()) {
+		return;
+	}
+	// Zero components give infinities, which the slab test handles
+	glm::vec3 invDir(1.0f/dir.x, 1.0f/dir.y, 1.0f/dir.z);
+	float tnear;
+	if(!intersectBox(nodes[0].min, nodes[0].max, origin, invDir, tmax, tnear)) {
+		return;
+	}
+	// Nodes still to visit, with where the ray enters them
+	int stack[MAX_DEPTH + 2];
+	float stackNear[MAX_DEPTH + 2];
+	int top = 0;
+	stack[top] = 0;
+	stackNear[top++] = tnear;
+	while(top > 0) {
+		--top;
+		if(stackNear[top] > tmax) {
+			continue;
+		}
+		int n = stack[top];
+		const Node &node = nodes[n];
+		if(node.count > 0) {
+			for(int i = node.index; i < node.index + node.count; ++i) {
+				visit(indices[i], tmax);
+			}
+			continue;
+		}
+		int a = n + 1;
+		int b = node.index;
+		float ta, tb;
+		bool hitA = intersectBox(nodes[a].min, nodes[a].max, origin, invDir, tmax, ta);
+		bool hitB = intersectBox(nodes[b].min, nodes[b].max, origin, invDir, tmax, tb);
+		if(hitA && hitB) {
+			// The nearer child goes on top
+			if(ta > tb) {
+				std::swap(a, b);
+				std::swap(ta, tb);
+			}
+			stack[top] = b;
+			stackNear[top++] = tb;
+			stack[top] = a;
+			stackNear[top++] = ta;
+		} else if(hitA) {
+			stack[top] = a;
+			stackNear[top++] = ta;
+		} else if(hitB) {
+			stack[top] = b;
+			stackNear[top++] = tb;
+		}
+	}
+}
+
+#endif
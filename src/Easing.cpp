@@ -0,0 +1,126 @@
+#include "Easing.h"
+
+#include <iostream>
+#include <fstream>
+#include <cmath>
+
+using namespace std;
+
+Easing::Easing()
+{
+	lut.push_back(0.0f);
+	lut.push_back(1.0f);
+	scale = 1.0f;
+}
+
+Easing::~Easing()
+{
+	
+}
+
+bool Easing::setControlPoints(const vector<glm::vec2> &points, int size)
+{
+	int n = (int)points.size();
+	if(n < 2 || size < 2) {
+		return false;
+	}
+	if(points[0].x != 0.0f || points[n - 1].x != 1.0f) {
+		return false;
+	}
+	for(int k = 0; k + 1 < n; ++k) {
+		if(points[k + 1].x <= points[k].x || points[k + 1].y < points[k].y) {
+			return false;
+		}
+	}
+	
+	// Tangents: average of the neighboring secants, zero at extrema, then
+	// limited so each segment stays monotone (Fritsch-Carlson)
+	vector<float> d(n - 1);
+	for(int k = 0; k + 1 < n; ++k) {
+		d[k] = (points[k + 1].y - points[k].y)/(points[k + 1].x - points[k].x);
+	}
+	vector<float> m(n);
+	m[0] = d[0];
+	m[n - 1] = d[n - 2];
+	for(int k = 1; k + 1 < n; ++k) {
+		m[k] = d[k - 1]*d[k] > 0.0f ? 0.5f*(d[k - 1] + d[k]) : 0.0f;
+	}
+	for(int k = 0; k + 1 < n; ++k) {
+		if(d[k] == 0.0f) {
+			m[k] = m[k + 1] = 0.0f;
+			continue;
+		}
+		float a = m[k]/d[k];
+		float b = m[k + 1]/d[k];
+		float r = a*a + b*b;
+		if(r > 9.0f) {
+			float tau = 3.0f/sqrt(r);
+			m[k] = tau*a*d[k];
+			m[k + 1] = tau*b*d[k];
+		}
+	}
+	
+	// Bake into the table
+	lut.resize(size);
+	int k = 0;
+	for(int i = 0; i < size; ++i) {
+		float x = (float)i/(size - 1);
+		while(k + 2 < n && x > points[k + 1].x) {
+			++k;
+		}
+		float h = points[k + 1].x - points[k].x;
+		float t = (x - points[k].x)/h;
+		float t2 = t*t;
+		float t3 = t2*t;
+		lut[i] = (2.0f*t3 - 3.0f*t2 + 1.0f)*points[k].y +
+		         (t3 - 2.0f*t2 + t)*h*m[k] +
+		         (-2.0f*t3 + 3.0f*t2)*points[k + 1].y +
+		         (t3 - t2)*h*m[k + 1];
+	}
+	scale = (float)(size - 1);
+	return true;
+}
+
+bool Easing::loadControlPoints(const string &fileName, int size)
+{
+	ifstream in(fileName.c_str());
+	if(!in.good()) {
+		cerr << "Cannot read " << fileName << endl;
+		return false;
+	}
+	vector<glm::vec2> points;
+	glm::vec2 p;
+	while(in >> p.x >> p.y) {
+		points.push_back(p);
+	}
+	if(!setControlPoints(points, size)) {
+		cerr << fileName << ": easing needs times from 0 to 1, increasing, and distances that never decrease" << endl;
+		return false;
+	}
+	return true;
+}
+
+Easing Easing::preset(int which)
+{
+	vector<glm::vec2> points;
+	points.push_back(glm::vec2(0.0f, 0.0f));
+	switch(which) {
+		case EASE_IN:
+			points.push_back(glm::vec2(0.5f, 0.2f));
+			break;
+		case EASE_OUT:
+			points.push_back(glm::vec2(0.5f, 0.8f));
+			break;
+		case EASE_IN_OUT:
+			points.push_back(glm::vec2(0.25f, 0.1f));
+			points.push_back(glm::vec2(0.5f, 0.5f));
+			points.push_back(glm::vec2(0.75f, 0.9f));
+			break;
+		default:
+			break;
+	}
+	points.push_back(glm::vec2(1.0f, 1.0f));
+	Easing easing;
+	easing.setControlPoints(points);
+	return easing;
+}
@@ -0,0 +1,59 @@
+#pragma  once
+#ifndef __Easing__
+#define __Easing__
+
+#include <string>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+/**
+ * Monotone time -> distance curve on [0, 1] -> [0, 1]
+ * - Defined by control points (time, distance) from (0, 0) to (1, 1),
+ *   interpolated with a monotone cubic Hermite spline (Fritsch-Carlson), so
+ *   the distance never runs backwards between points.
+ * - The curve is baked once into a uniform table; evaluate() is one lookup
+ *   and a lerp.
+ * - A default constructed Easing is linear.
+ */
+class Easing
+{
+public:
+	enum {
+		LINEAR = 0,
+		EASE_IN,
+		EASE_OUT,
+		EASE_IN_OUT,
+		PRESETS
+	};
+	enum {
+		DEFAULT_SIZE = 256
+	};
+	
+	Easing();
+	virtual ~Easing();
+	
+	// Returns false (and keeps the old curve) unless times run from 0 to 1,
+	// increasing strictly, and distances never decrease
+	bool setControlPoints(const std::vector<glm::vec2> &points, int size = DEFAULT_SIZE);
+	// One "time distance" pair per line
+	bool loadControlPoints(const std::string &fileName, int size = DEFAULT_SIZE);
+	static Easing preset(int which);
+	
+	float evaluate(float x) const
+	{
+		x = glm::clamp(x, 0.0f, 1.0f)*scale;
+		int i = (int)x;
+		if(i >= (int)lut.size() - 1) {
+			return lut.back();
+		}
+		return lut[i] + (x - i)*(lut[i + 1] - lut[i]);
+	}
+	
+private:
+	std::vector<float> lut;
+	float scale; // lut.size() - 1
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include "Fleet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "FrameClock.h"
+#include "GLSL.h"
+#include "GLState.h"
+#include "Helicopter.h"
+#include "JobSystem.h"
+#include "MatrixStack.h"
+#include "Program.h"
+#include "Shape.h"
+#include "Spline.h"
+#include "Trace.h"
+#include "UniformBuffer.h"
+
+using namespace std;
+
+static const int A_INST_POS = Program::attributeHandle("aInstPos");
+static const int A_INST_ROT = Program::attributeHandle("aInstRot");
+
+// Helicopters per job; small enough to balance, large enough to amortize
+static const int GRAIN = 1024;
+
+Fleet::Fleet() :
+	count(0)
+{
+	
+}
+
+Fleet::~Fleet()
+{
+	
+}
+
+bool Fleet::isSupported()
+{
+	return GLEW_ARB_draw_instanced && GLEW_ARB_instanced_arrays;
+}
+
+void Fleet::printStats() const
+{
+	printf("Fleet instances: %s, %lu stalls\n",
+	       instanceStream.isPersistent() ? "persistent mapping" : "glBufferSubData", instanceStream.getStalls());
+}
+
+void Fleet::init(int count, shared_ptr<Spline> spline, const vector<glm::quat> &rots,
+                 const vector<Easing> &profiles, unsigned seed)
+{
+	this->count = count;
+	this->spline = spline;
+	this->rots = rots;
+	this->profiles = profiles;
+	if(this->profiles.empty()) {
+		this->profiles.push_back(Easing());
+	}
+	phase.resize(count);
+	rate.resize(count);
+	profile.resize(count);
+	s.resize(count);
+	ox.resize(count);
+	oy.resize(count);
+	oz.resize(count);
+	px.resize(count);
+	py.resize(count);
+	pz.resize(count);
+	qx.resize(count);
+	qy.resize(count);
+	qz.resize(count);
+	qw.resize(count);
+	
+	// The single helicopter takes about 11 seconds per loop; the fleet flies
+	// at half to one and a half times that speed, spread over a box that
+	// grows with the fleet.
+	const float radius = 1.0f + 0.05f*sqrt((float)count);
+	const int nprofiles = (int)min(this->profiles.size(), (size_t)256);
+	mt19937 rng(seed);
+	uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for(int i = 0; i < count; ++i) {
+		phase[i] = unit(rng);
+		rate[i] = (0.5f + unit(rng))/11.0f;
+		profile[i] = (unsigned char)(rng() % nprofiles);
+		ox[i] = radius*(2.0f*unit(rng) - 1.0f);
+		oy[i] = 0.25f*radius*(2.0f*unit(rng) - 1.0f);
+		oz[i] = radius*(2.0f*unit(rng) - 1.0f);
+	}
+}
+
+void Fleet::initGL()
+{
+	instanceStream.init(2*count*sizeof(glm::vec4));
+}
+
+void Fleet::initCulling(shared_ptr<Program> progCull, const Helicopter &helicopter)
+{
+	const Shape *shapes[Helicopter::PARTS];
+	glm::mat4 transforms[Helicopter::PARTS];
+	helicopter.getParts(make_shared<MatrixStack>(), FrameTime(), shapes, transforms);
+	vector<int> vertexCounts;
+	for(int i = 0; i < Helicopter::PARTS; ++i) {
+		vertexCounts.push_back(shapes[i]->getVertexCount());
+	}
+	culler = make_shared<InstanceCuller>();
+	culler->init(progCull, count, vertexCounts);
+}
+
+void Fleet::update(JobSystem &jobs, float dt, vector<glm::vec4> &instances)
+{
+	instances.resize(2*count);
+	glm::vec4 *out = instances.empty() ? NULL : &instances[0];
+	jobs.parallelFor(count, GRAIN, [this, dt, out](int worker, int begin, int end) {
+		updateRange(begin, end, dt, out);
+	});
+}
+
+void Fleet::updateRange(int begin, int end, float dt, glm::vec4 *instances)
+{
+	TraceScope trace("Fleet::update");
+	
+	// Advance the phases and wrap them around the closed path. A plain loop
+	// over contiguous floats (no floor() call), so it vectorizes.
+	float *phase = &this->phase[0];
+	const float *rate = &this->rate[0];
+	for(int i = begin; i < end; ++i) {
+		float f = phase[i] + rate[i]*dt;
+		phase[i] = f - (float)(int)f;
+	}
+	
+	// Arc length through each helicopter's easing table
+	const float smax = spline->getLength();
+	for(int i = begin; i < end; ++i) {
+		s[i] = smax*profiles[profile[i]].evaluate(phase[i]);
+	}
+	
+	// Pose on the path
+	for(int i = begin; i < end; ++i) {
+		float u = spline->s2u(s[i]);
+		glm::vec3 p = spline->position(u);
+		glm::quat q = spline->rotation(rots, u);
+		px[i] = p.x + ox[i];
+		py[i] = p.y + oy[i];
+		pz[i] = p.z + oz[i];
+		qx[i] = q.x;
+		qy[i] = q.y;
+		qz[i] = q.z;
+		qw[i] = q.w;
+	}
+	
+	// Pack for the GPU
+	for(int i = begin; i < end; ++i) {
+		instances[2*i] = glm::vec4(px[i], py[i], pz[i], 1.0f);
+		instances[2*i + 1] = glm::vec4(qx[i], qy[i], qz[i], qw[i]);
+	}
+}
+
+void Fleet::draw(const shared_ptr<Program> prog, const Helicopter &helicopter, shared_ptr<UniformBuffer> obj,
+                 const FrameTime &time, const glm::mat4 &PV, const vector<glm::vec4> &instances)
+{
+	// Nothing to draw until the first update
+	if(count == 0 || (int)instances.size() < 2*count) {
+		return;
+	}
+	int h_pos = prog->getAttribute(A_INST_POS);
+	int h_rot = prog->getAttribute(A_INST_ROT);
+	if(h_pos == -1 || h_rot == -1) {
+		return;
+	}
+	
+	// This frame's instances go to a segment the GPU is done reading. The
+	// offset must also be valid for a shader storage binding.
+	instanceStream.beginFrame();
+	GLintptr offset = instanceStream.write(&instances[0], 2*count*sizeof(glm::vec4), 256);
+	
+	const Shape *shapes[Helicopter::PARTS];
+	glm::mat4 transforms[Helicopter::PARTS];
+	helicopter.getParts(make_shared<MatrixStack>(), time, shapes, transforms);
+	
+	if(culler) {
+		// Sphere around the helicopter's origin, which is what each instance
+		// moves and rotates
+		float radius = 0.0f;
+		for(int i = 0; i < Helicopter::PARTS; ++i) {
+			glm::vec3 center(transforms[i] * glm::vec4(shapes[i]->getCenter(), 1.0f));
+			radius = max(radius, glm::length(center) + shapes[i]->getRadius());
+		}
+		culler->cull(instanceStream.getID(), offset, count, PV, radius);
+		GLState::bindArrayBuffer(culler->getInstanceBuffer());
+		offset = 0;
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culler->getCommandBuffer());
+	} else {
+		GLState::bindArrayBuffer(instanceStream.getID());
+	}
+	prog->bind();
+	glVertexAttribPointer(h_pos, 4, GL_FLOAT, GL_FALSE, 2*sizeof(glm::vec4), (const void *)offset);
+	glVertexAttribPointer(h_rot, 4, GL_FLOAT, GL_FALSE, 2*sizeof(glm::vec4), (const void *)(offset + sizeof(glm::vec4)));
+	GLState::vertexAttribDivisor(h_pos, 1);
+	GLState::vertexAttribDivisor(h_rot, 1);
+	unsigned instanceArrays = 1u << h_pos | 1u << h_rot;
+	
+	// One instanced draw per part; M in the object block places the part
+	// within the helicopter
+	for(int i = 0; i < Helicopter::PARTS; ++i) {
+		obj->push(glm::value_ptr(transforms[i]), sizeof(glm::mat4));
+		shapes[i]->bind(prog, instanceArrays);
+		if(culler) {
+			shapes[i]->drawIndirect(i*sizeof(InstanceCuller::DrawCommand));
+		} else {
+			shapes[i]->drawInstanced(count);
+		}
+	}
+	if(culler) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	
+	// Other programs may use these attribute indices for per-vertex data
+	GLState::vertexAttribDivisor(h_pos, 0);
+	GLState::vertexAttribDivisor(h_rot, 0);
+	GLSL::checkError(GET_FILE_LINE);
+}
@@ -0,0 +1,90 @@
+#pragma  once
+#ifndef __Fleet__
+#define __Fleet__
+
+#include <memory>
+#include <vector>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include "Easing.h"
+#include "InstanceCuller.h"
+#include "StreamBuffer.h"
+
+class Helicopter;
+class JobSystem;
+class Program;
+class Spline;
+class UniformBuffer;
+struct FrameTime;
+
+/**
+ * Many helicopters flying the same path, each with its own start, speed,
+ * easing profile and offset from the path.
+ * - State is stored structure-of-arrays, so the per-frame update streams
+ *   through contiguous floats and the simple loops vectorize.
+ * - update() splits the fleet over all job threads and packs one
+ *   (position, rotation) pair per helicopter into an instance array; it
+ *   makes no GL calls, so it can run on the simulation thread.
+ * - draw() uploads an instance array and draws
+ *   each part of the helicopter once for the whole fleet with instancing
+ *   (ARB_draw_instanced and ARB_instanced_arrays). The program reads them
+ *   from aInstPos and aInstRot.
+ * - With initCulling(), a compute pass first drops the helicopters outside
+ *   the view frustum, and the parts are drawn with indirect commands whose
+ *   instance counts never leave the GPU.
+ */
+class Fleet
+{
+public:
+	enum {
+		MAX_SIZE = 100000
+	};
+	
+	Fleet();
+	virtual ~Fleet();
+	
+	// Spreads count helicopters over the path, each using one of the easing
+	// profiles. The same seed gives the same fleet.
+	void init(int count, std::shared_ptr<Spline> spline, const std::vector<glm::quat> &rots,
+	          const std::vector<Easing> &profiles, unsigned seed = 1);
+	void initGL();
+	// progCull is the compute program built from cull_comp.glsl
+	void initCulling(std::shared_ptr<Program> progCull, const Helicopter &helicopter);
+	int getSize() const { return count; }
+	
+	// Moves every helicopter dt seconds along the path
+	void update(JobSystem &jobs, float dt, std::vector<glm::vec4> &instances);
+	// PV is the camera's projection times view, for culling
+	void draw(const std::shared_ptr<Program> prog, const Helicopter &helicopter, std::shared_ptr<UniformBuffer> obj,
+	          const FrameTime &time, const glm::mat4 &PV, const std::vector<glm::vec4> &instances);
+	
+	static bool isSupported();
+	// Instance buffer mode and how often it waited for the GPU
+	void printStats() const;
+	
+private:
+	void updateRange(int begin, int end, float dt, glm::vec4 *instances);
+	
+	int count;
+	std::shared_ptr<Spline> spline;
+	std::vector<glm::quat> rots;
+	std::vector<Easing> profiles;
+	// Per helicopter
+	std::vector<float> phase;      // fraction of the loop, in [0, 1)
+	std::vector<float> rate;       // loops per second
+	std::vector<unsigned char> profile; // index into profiles
+	std::vector<float> s;          // arc length, eased from the phase
+	std::vector<float> ox, oy, oz; // offset from the path
+	std::vector<float> px, py, pz; // position
+	std::vector<float> qx, qy, qz, qw; // orientation
+	StreamBuffer instanceStream;
+	std::shared_ptr<InstanceCuller> culler; // NULL without initCulling()
+};
+
+#endif
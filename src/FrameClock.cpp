@@ -0,0 +1,88 @@
+#include "FrameClock.h"
+
+#include <iostream>
+#include <fstream>
+
+using namespace std;
+
+FrameClock::FrameClock() :
+	mode(FrameClock::REALTIME),
+	step(1.0/60.0),
+	started(false)
+{
+	reset();
+}
+
+FrameClock::~FrameClock()
+{
+}
+
+void FrameClock::setRealTime()
+{
+	mode = FrameClock::REALTIME;
+}
+
+void FrameClock::setFixedStep(double dt)
+{
+	mode = FrameClock::FIXED;
+	step = dt;
+}
+
+bool FrameClock::loadScript(const string &fileName)
+{
+	ifstream in(fileName.c_str());
+	if(!in.good()) {
+		cerr << "Cannot read frame times from " << fileName << endl;
+		return false;
+	}
+	vector<double> times;
+	double t;
+	while(in >> t) {
+		times.push_back(t);
+	}
+	if(times.empty()) {
+		cerr << "No frame times in " << fileName << endl;
+		return false;
+	}
+	return setScript(times);
+}
+
+bool FrameClock::setScript(const vector<double> &times)
+{
+	if(times.empty()) {
+		return false;
+	}
+	script = times;
+	mode = FrameClock::SCRIPTED;
+	return true;
+}
+
+void FrameClock::reset()
+{
+	start = chrono::steady_clock::now();
+	current = FrameTime();
+	started = false;
+}
+
+const FrameTime &FrameClock::tick()
+{
+	// The first tick after reset() is frame 0, later ticks advance
+	long frame = started ? current.frame + 1 : 0;
+	double t = 0.0;
+	switch(mode) {
+		case FrameClock::REALTIME:
+			t = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			break;
+		case FrameClock::FIXED:
+			t = frame*step;
+			break;
+		case FrameClock::SCRIPTED:
+			t = script[frame < (long)script.size() ? frame : script.size() - 1];
+			break;
+	}
+	current.dt = started ? t - current.t : 0.0;
+	current.t = t;
+	current.frame = frame;
+	started = true;
+	return current;
+}
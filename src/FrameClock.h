@@ -0,0 +1,64 @@
+#pragma  once
+#ifndef __FrameClock__
+#define __FrameClock__
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+/**
+ * Time for one frame. Taken once per frame and passed down to everything
+ * that animates, so all objects in a frame see exactly the same time.
+ */
+struct FrameTime
+{
+	FrameTime() : t(0.0), dt(0.0), frame(0) {}
+	double t;   // seconds since the clock was reset
+	double dt;  // seconds since the previous frame
+	long frame; // index of this frame
+};
+
+/**
+ * Source of frame times
+ * - REALTIME: wall clock time
+ * - FIXED: frame*dt, independent of how long frames take to render
+ * - SCRIPTED: times read from a file (one per line) or given by the caller;
+ *   the last time is held once the script runs out
+ */
+class FrameClock
+{
+public:
+	enum {
+		REALTIME = 0,
+		FIXED,
+		SCRIPTED
+	};
+	
+	FrameClock();
+	virtual ~FrameClock();
+	
+	void setRealTime();
+	void setFixedStep(double dt);
+	bool loadScript(const std::string &fileName);
+	// Frame times given directly (e.g. recorded with an InputLog)
+	bool setScript(const std::vector<double> &times);
+	int getMode() const { return mode; }
+	// Number of frames in the script (0 if not scripted)
+	long getScriptLength() const { return (long)script.size(); }
+	
+	// Restarts at t = 0, frame 0
+	void reset();
+	// Advances to the next frame and returns its time
+	const FrameTime &tick();
+	const FrameTime &now() const { return current; }
+	
+private:
+	int mode;
+	double step;
+	std::vector<double> script;
+	std::chrono::steady_clock::time_point start;
+	FrameTime current;
+	bool started;
+};
+
+#endif
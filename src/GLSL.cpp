@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <cassert>
 #include <cstring>
+#include <atomic>
 
 using namespace std;
 
@@ -51,8 +52,96 @@ void checkVersion()
 	}
 }
 
-void checkError(const char *str)
+// Set by enableDebugOutput()
+static bool debugOutput = false;
+// Latest location passed to checkError(), for tagging debug messages
+static atomic<const char *> lastLocation(NULL);
+
+static const char *debugSourceString(GLenum source)
+{
+	switch(source) {
+	case GL_DEBUG_SOURCE_API:
+		return "API";
+	case GL_DEBUG_SOURCE_WINDOW_SYSTEM:
+		return "window system";
+	case GL_DEBUG_SOURCE_SHADER_COMPILER:
+		return "shader compiler";
+	case GL_DEBUG_SOURCE_THIRD_PARTY:
+		return "third party";
+	case GL_DEBUG_SOURCE_APPLICATION:
+		return "application";
+	default:
+		return "other";
+	}
+}
+
+static const char *debugTypeString(GLenum type)
+{
+	switch(type) {
+	case GL_DEBUG_TYPE_ERROR:
+		return "error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+		return "deprecated";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+		return "undefined behavior";
+	case GL_DEBUG_TYPE_PORTABILITY:
+		return "portability";
+	case GL_DEBUG_TYPE_PERFORMANCE:
+		return "performance";
+	default:
+		return "other";
+	}
+}
+
+static void GLAPIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                     GLsizei length, const GLchar *message, const void *userParam)
 {
+	if(severity == GL_DEBUG_SEVERITY_NOTIFICATION) {
+		return;
+	}
+	const char *location = lastLocation.load(memory_order_relaxed);
+	printf("GL %s (%s, id %u)", debugTypeString(type), debugSourceString(source), id);
+	if(location) {
+		// Asynchronous messages can arrive after later checkpoints, so this
+		// is the most recent checkpoint, not necessarily the offending call.
+		printf(" after %s", location);
+	}
+	printf(": %s\n", message);
+	assert(type != GL_DEBUG_TYPE_ERROR);
+}
+
+bool enableDebugOutput(bool synchronous)
+{
+	if(!(GLEW_KHR_debug || GLEW_VERSION_4_3)) {
+		return false;
+	}
+	// Non-debug contexts may not emit any messages, so only a debug context
+	// can stop polling glGetError
+	GLint flags = 0;
+	if(GLEW_VERSION_3_0) {
+		glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+	}
+	if(!(flags & GL_CONTEXT_FLAG_DEBUG_BIT)) {
+		return false;
+	}
+	glEnable(GL_DEBUG_OUTPUT);
+	if(synchronous) {
+		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	} else {
+		glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	}
+	glDebugMessageCallback(debugCallback, NULL);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
+	debugOutput = true;
+	return true;
+}
+
+void checkErrorNow(const char *str)
+{
+	if(debugOutput) {
+		lastLocation.store(str, memory_order_relaxed);
+		return;
+	}
 	GLenum glErr = glGetError();
 	if(glErr != GL_NO_ERROR) {
 		if(str) {
@@ -63,6 +152,34 @@ void checkError(const char *str)
 	}
 }
 
+void clearErrors(const char *str)
+{
+	GLenum glErr;
+	while((glErr = glGetError()) != GL_NO_ERROR) {
+		if(debugOutput) {
+			continue;
+		}
+		if(str) {
+			printf("%s: ", str);
+		}
+		printf("GL_ERROR = %s.\n", errorString(glErr));
+	}
+}
+
+void beginExpectedErrors()
+{
+	if(debugOutput) {
+		glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DONT_CARE, 0, NULL, GL_FALSE);
+	}
+}
+
+void endExpectedErrors()
+{
+	if(debugOutput) {
+		glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DONT_CARE, 0, NULL, GL_TRUE);
+	}
+}
+
 void printShaderInfoLog(GLuint shader)
 {
 	GLint infologLength = 0;
@@ -14,23 +14,49 @@
 ///////////////////////////////////////////////////////////////////////////////
 // For printing out the current file and line number                         //
 ///////////////////////////////////////////////////////////////////////////////
-#include <sstream>
-
-template <typename T>
-std::string NumberToString(T x)
-{
-	std::ostringstream ss;
-	ss << x;
-	return ss.str();
-}
+#define GLSL_STRINGIFY2(x) #x
+#define GLSL_STRINGIFY(x) GLSL_STRINGIFY2(x)
+// A string literal, so it costs nothing at runtime
+#define GET_FILE_LINE (__FILE__ ":" GLSL_STRINGIFY(__LINE__))
+///////////////////////////////////////////////////////////////////////////////
 
-#define GET_FILE_LINE (std::string(__FILE__) + ":" + NumberToString(__LINE__)).c_str()
+///////////////////////////////////////////////////////////////////////////////
+// GL error checks are compiled out of release builds (NDEBUG). Override    //
+// with -DGLSL_CHECK_ERRORS=0 or 1.                                          //
+///////////////////////////////////////////////////////////////////////////////
+#ifndef GLSL_CHECK_ERRORS
+#ifdef NDEBUG
+#define GLSL_CHECK_ERRORS 0
+#else
+#define GLSL_CHECK_ERRORS 1
+#endif
+#endif
 ///////////////////////////////////////////////////////////////////////////////
 
 namespace GLSL {
 
 	void checkVersion();
-	void checkError(const char *str = 0);
+	// Installs a KHR_debug message callback so errors are reported by the
+	// driver instead of polled with glGetError. Returns false if KHR_debug is
+	// not available or the context is not a debug context (checkError() then
+	// keeps polling).
+	bool enableDebugOutput(bool synchronous = false);
+	// Polls glGetError, or with debug output enabled only records str as the
+	// latest location, which the callback prints with each message.
+	void checkErrorNow(const char *str);
+	// Reports (unless debug output already did) and clears every pending
+	// glGetError flag, whatever GLSL_CHECK_ERRORS says. Call before a GL call
+	// whose own error is to be read.
+	void clearErrors(const char *str);
+	// Errors raised between the two calls are expected (e.g. a rejected
+	// program binary), so debug output does not report them
+	void beginExpectedErrors();
+	void endExpectedErrors();
+#if GLSL_CHECK_ERRORS
+	inline void checkError(const char *str = 0) { checkErrorNow(str); }
+#else
+	inline void checkError(const char *str = 0) {}
+#endif
 	void printProgramInfoLog(GLuint program);
 	void printShaderInfoLog(GLuint shader);
 	int textFileWrite(const char *filename, const char *s);
@@ -0,0 +1,180 @@
+#include "GLState.h"
+
+#include <stdio.h>
+
+namespace GLState {
+
+// Capabilities toggled with enable()/disable(); anything else is passed
+// straight through.
+static const GLenum caps[] = { GL_CULL_FACE, GL_DEPTH_TEST, GL_BLEND };
+static const int NCAPS = sizeof(caps)/sizeof(caps[0]);
+
+// -1 means unknown, so the first call is always issued
+static int capState[NCAPS] = { -1, -1, -1 };
+static GLint polygonModeState = -1;
+static GLint viewportState[4] = { -1, -1, -1, -1 };
+static GLfloat lineWidthState = -1.0f;
+static GLint programState = -1;
+static GLint arrayBufferState = -1;
+static unsigned attribMask = 0;
+static bool attribMaskKnown = false;
+static GLint divisorState[32] = { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+static Counters counters;
+
+void reset()
+{
+	for(int i = 0; i < NCAPS; ++i) {
+		capState[i] = -1;
+	}
+	polygonModeState = -1;
+	viewportState[0] = viewportState[1] = viewportState[2] = viewportState[3] = -1;
+	lineWidthState = -1.0f;
+	programState = -1;
+	arrayBufferState = -1;
+	attribMask = 0;
+	attribMaskKnown = false;
+	for(int i = 0; i < 32; ++i) {
+		divisorState[i] = -1;
+	}
+}
+
+static int capIndex(GLenum cap)
+{
+	for(int i = 0; i < NCAPS; ++i) {
+		if(caps[i] == cap) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Returns true if the call must be issued, and counts it either way
+static bool changed(bool differs)
+{
+	if(differs) {
+		++counters.issued;
+	} else {
+		++counters.filtered;
+	}
+	return differs;
+}
+
+void enable(GLenum cap)
+{
+	int i = capIndex(cap);
+	if(i < 0) {
+		++counters.issued;
+		glEnable(cap);
+	} else if(changed(capState[i] != 1)) {
+		glEnable(cap);
+		capState[i] = 1;
+	}
+}
+
+void disable(GLenum cap)
+{
+	int i = capIndex(cap);
+	if(i < 0) {
+		++counters.issued;
+		glDisable(cap);
+	} else if(changed(capState[i] != 0)) {
+		glDisable(cap);
+		capState[i] = 0;
+	}
+}
+
+void polygonMode(GLenum mode)
+{
+	if(changed(polygonModeState != (GLint)mode)) {
+		glPolygonMode(GL_FRONT_AND_BACK, mode);
+		polygonModeState = mode;
+	}
+}
+
+void viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if(changed(viewportState[0] != x || viewportState[1] != y || viewportState[2] != width || viewportState[3] != height)) {
+		glViewport(x, y, width, height);
+		viewportState[0] = x;
+		viewportState[1] = y;
+		viewportState[2] = width;
+		viewportState[3] = height;
+	}
+}
+
+void lineWidth(GLfloat width)
+{
+	if(changed(lineWidthState != width)) {
+		glLineWidth(width);
+		lineWidthState = width;
+	}
+}
+
+void useProgram(GLuint program)
+{
+	if(changed(programState != (GLint)program)) {
+		glUseProgram(program);
+		programState = program;
+	}
+}
+
+void bindArrayBuffer(GLuint buffer)
+{
+	if(changed(arrayBufferState != (GLint)buffer)) {
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		arrayBufferState = buffer;
+	}
+}
+
+void vertexAttribArrays(unsigned mask)
+{
+	// Only touch the arrays whose state differs. While the state is unknown,
+	// the first 16 arrays (the minimum every implementation has) are set.
+	unsigned diff = attribMaskKnown ? (mask ^ attribMask) : (mask | 0xFFFFu);
+	if(!diff) {
+		changed(false);
+	}
+	for(unsigned i = 0; i < 32; ++i) {
+		if((diff >> i) & 1u) {
+			changed(true);
+			if((mask >> i) & 1u) {
+				glEnableVertexAttribArray(i);
+			} else {
+				glDisableVertexAttribArray(i);
+			}
+		}
+	}
+	attribMask = mask;
+	attribMaskKnown = true;
+}
+
+void vertexAttribDivisor(GLuint index, GLuint divisor)
+{
+	if(index >= 32) {
+		++counters.issued;
+		glVertexAttribDivisorARB(index, divisor);
+	} else if(changed(divisorState[index] != (GLint)divisor)) {
+		glVertexAttribDivisorARB(index, divisor);
+		divisorState[index] = divisor;
+	}
+}
+
+const Counters &getCounters()
+{
+	return counters;
+}
+
+void resetCounters()
+{
+	counters = Counters();
+}
+
+void printCounters()
+{
+	unsigned long total = counters.issued + counters.filtered;
+	printf("GL state calls: %lu issued, %lu filtered (%.1f%%)\n", counters.issued, counters.filtered,
+	       total ? 100.0*counters.filtered/total : 0.0);
+}
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+#ifndef __GLState__
+#define __GLState__
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+/**
+ * Cache of the GL state that changes during a frame. Calls that would set a
+ * value the context already has are dropped before reaching the driver.
+ * All GL calls for this state must go through here (or be followed by
+ * reset()) so the cache stays in sync with the context.
+ */
+namespace GLState {
+
+	struct Counters
+	{
+		Counters() : issued(0), filtered(0) {}
+		unsigned long issued;   // calls passed on to GL
+		unsigned long filtered; // redundant calls dropped
+	};
+	
+	// Forgets all cached values, so the next call of each kind is issued
+	void reset();
+	
+	void enable(GLenum cap);
+	void disable(GLenum cap);
+	void polygonMode(GLenum mode); // GL_FRONT_AND_BACK
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	void lineWidth(GLfloat width);
+	void useProgram(GLuint program);
+	void bindArrayBuffer(GLuint buffer);
+	// Enables exactly the generic vertex attribute arrays whose bits are set
+	void vertexAttribArrays(unsigned mask);
+	// Instancing divisor of a generic vertex attribute (ARB_instanced_arrays)
+	void vertexAttribDivisor(GLuint index, GLuint divisor);
+	
+	const Counters &getCounters();
+	void resetCounters();
+	void printCounters();
+}
+
+#endif
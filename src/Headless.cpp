@@ -0,0 +1,171 @@
+#include "Headless.h"
+
+#include <iostream>
+#include <vector>
+#include <stdio.h>
+
+#ifdef __linux__
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "GLSL.h"
+
+using namespace std;
+
+Headless::Headless() :
+	display(0),
+	context(0),
+	fboID(0),
+	colorBufID(0),
+	depthBufID(0),
+	width(0),
+	height(0)
+{
+	
+}
+
+Headless::~Headless()
+{
+#ifdef __linux__
+	if(display) {
+		eglMakeCurrent((EGLDisplay)display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if(context) {
+			eglDestroyContext((EGLDisplay)display, (EGLContext)context);
+		}
+		eglTerminate((EGLDisplay)display);
+	}
+#endif
+}
+
+bool Headless::initContext()
+{
+#ifdef __linux__
+	// Prefer Mesa's surfaceless platform, which needs no display server or
+	// GPU device, and fall back to the default display.
+	EGLDisplay dpy = EGL_NO_DISPLAY;
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if(getPlatformDisplay) {
+		dpy = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+#endif
+	if(dpy == EGL_NO_DISPLAY) {
+		dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	EGLint major, minor;
+	if(dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, &major, &minor)) {
+		cerr << "Failed to initialize EGL" << endl;
+		return false;
+	}
+	display = dpy;
+	
+	// Desktop GL (compatibility profile, since the scene uses immediate mode)
+	if(!eglBindAPI(EGL_OPENGL_API)) {
+		cerr << "EGL does not support desktop OpenGL" << endl;
+		return false;
+	}
+	const EGLint configAttribs[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint nconfigs = 0;
+	if(!eglChooseConfig(dpy, configAttribs, &config, 1, &nconfigs) || nconfigs == 0) {
+		cerr << "No suitable EGL config" << endl;
+		return false;
+	}
+	EGLContext ctx = EGL_NO_CONTEXT;
+#if GLSL_CHECK_ERRORS && defined(EGL_CONTEXT_FLAGS_KHR)
+	// A debug context, as the window asks for with GLFW_OPENGL_DEBUG_CONTEXT,
+	// so KHR_debug output reports errors
+	const EGLint debugAttribs[] = {
+		EGL_CONTEXT_FLAGS_KHR, EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR,
+		EGL_NONE
+	};
+	ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT, debugAttribs);
+#endif
+	if(ctx == EGL_NO_CONTEXT) {
+		ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT, NULL);
+	}
+	if(ctx == EGL_NO_CONTEXT) {
+		cerr << "Failed to create EGL context" << endl;
+		return false;
+	}
+	context = ctx;
+	// No surface at all: everything is drawn into our own framebuffer
+	if(!eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx)) {
+		cerr << "Surfaceless EGL contexts are not supported" << endl;
+		return false;
+	}
+	return true;
+#else
+	cerr << "Headless rendering is only supported on Linux" << endl;
+	return false;
+#endif
+}
+
+bool Headless::initFramebuffer(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	
+	glGenRenderbuffers(1, &colorBufID);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorBufID);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &depthBufID);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBufID);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	
+	glGenFramebuffers(1, &fboID);
+	glBindFramebuffer(GL_FRAMEBUFFER, fboID);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBufID);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBufID);
+	// With no default framebuffer, draw and read buffers must name the FBO
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if(status != GL_FRAMEBUFFER_COMPLETE) {
+		cerr << "Incomplete framebuffer: 0x" << hex << status << dec << endl;
+		return false;
+	}
+	GLSL::checkError(GET_FILE_LINE);
+	return true;
+}
+
+void Headless::bind() const
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, fboID);
+}
+
+void Headless::readPixels(vector<unsigned char> &pixels) const
+{
+	pixels.resize(3*width*height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+}
+
+bool Headless::writePPM(const string &fileName) const
+{
+	vector<unsigned char> pixels;
+	readPixels(pixels);
+	FILE *fp = fopen(fileName.c_str(), "wb");
+	if(fp == NULL) {
+		cerr << "Cannot write " << fileName << endl;
+		return false;
+	}
+	fprintf(fp, "P6\n%d %d\n255\n", width, height);
+	// GL rows go bottom to top
+	for(int y = height - 1; y >= 0; --y) {
+		fwrite(&pixels[3*width*y], 1, 3*width, fp);
+	}
+	fclose(fp);
+	return true;
+}
@@ -0,0 +1,44 @@
+#pragma  once
+#ifndef __Headless__
+#define __Headless__
+
+#include <string>
+#include <vector>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+/**
+ * Offscreen rendering without a window or display server
+ * - initContext() creates a surfaceless EGL context (Mesa llvmpipe works);
+ *   call it in place of creating a GLFW window, before glewInit()
+ * - initFramebuffer() creates the FBO that all frames are rendered into
+ */
+class Headless
+{
+public:
+	Headless();
+	virtual ~Headless();
+	
+	bool initContext();
+	bool initFramebuffer(int width, int height);
+	void bind() const;
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	
+	// Reads the current color buffer: RGB, rows bottom to top
+	void readPixels(std::vector<unsigned char> &pixels) const;
+	// Writes the current color buffer as a binary PPM
+	bool writePPM(const std::string &fileName) const;
+	
+private:
+	void *display; // EGLDisplay
+	void *context; // EGLContext
+	GLuint fboID;
+	GLuint colorBufID;
+	GLuint depthBufID;
+	int width;
+	int height;
+};
+
+#endif
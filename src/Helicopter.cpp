@@ -1,12 +1,12 @@
 #include "Helicopter.h"
 #include "Shape.h"
 #include "Program.h"
-
-//#include <GL/glew.h>
-#include <GLFW/glfw3.h>
+#include "RenderQueue.h"
+#include "FrameClock.h"
+#include "JobSystem.h"
+#include "MeshArena.h"
 
 #include <glm/glm.hpp>
-#include <glm/gtc/type_ptr.hpp>
 //#include <glm/gtc/matrix_transform.hpp>
 //#include <glm/gtx/quaternion.hpp>
 
@@ -18,62 +18,81 @@ Helicopter::~Helicopter() {
 
 }
 
-void Helicopter::init(std::string DIR, std::string body1, std::string body2, std::string prop1, std::string prop2) {
+void Helicopter::init(std::shared_ptr<JobSystem> jobs, std::string DIR, std::string body1, std::string body2, std::string prop1, std::string prop2) {
+	load(jobs, DIR, body1, body2, prop1, prop2);
+	b1.init();
+	b2.init();
+	p1.init();
+	p2.init();
+}
+void Helicopter::load(std::shared_ptr<JobSystem> jobs, std::string DIR, std::string body1, std::string body2, std::string prop1, std::string prop2) {
 	
 	b1 = Shape();
-	b1.loadMesh(DIR + body1);
-	b1.init();
-
 	b2 = Shape();
-	b2.loadMesh(DIR + body2);
-	b2.init();
-
 	p1 = Shape();
-	p1.loadMesh(DIR + prop1);
-	p1.init();
-
 	p2 = Shape();
-	p2.loadMesh(DIR + prop2);
-	p2.init();
+
+	// OBJ parsing needs no GL, so the four meshes load at the same time,
+	// each with its picking BVH
+	Shape *shapes[4] = { &b1, &b2, &p1, &p2 };
+	std::string names[4] = { body1, body2, prop1, prop2 };
+	jobs->parallelFor(4, 1, [&](int worker, int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			shapes[i]->loadMesh(DIR + names[i]);
+			shapes[i]->buildBvh();
+		}
+	});
+}
+void Helicopter::addMeshes(MeshArena &arena) const {
+	arena.add(p1);
+	arena.add(p2);
+	arena.add(b1);
+	arena.add(b2);
 }
 void Helicopter::propRotate(bool rotate) {
 	rotate_prop = rotate;
 }
-void Helicopter::draw(const std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> MV) {
-	t = glfwGetTime();
+void Helicopter::getParts(std::shared_ptr<MatrixStack> M, const FrameTime &time, const Shape *shapes[PARTS], glm::mat4 transforms[PARTS]) const {
 	float theta;
 
 	if (rotate_prop) {
-		theta = (float)((int)(t * 360) % 360);
+		theta = (float)((int)(time.t * 360) % 360);
 	} 
 	else {
 		theta = 0;
 	}
-	MV->pushMatrix();
-	//MV->translate(0, 0.5, 0);
+	M->pushMatrix();
+	//M->translate(0, 0.5, 0);
 	// Helicopter_prop1 
-	MV->pushMatrix();
-	MV->translate(0.0, 0.4819, 0.0);
-	MV->rotate(glm::radians(theta), 0, 1, 0);
-	MV->translate(0.0, -0.4819, 0.0);
-	glUniformMatrix4fv(prog->getUniform("MV"), 1, GL_FALSE, glm::value_ptr(MV->topMatrix()));
-	MV->popMatrix();
-	p1.draw(prog);
+	M->pushMatrix();
+	M->translate(0.0, 0.4819, 0.0);
+	M->rotate(glm::radians(theta), 0, 1, 0);
+	M->translate(0.0, -0.4819, 0.0);
+	shapes[0] = &p1;
+	transforms[0] = M->topMatrix();
+	M->popMatrix();
 
 	// Helicopter_prop2
-	MV->pushMatrix();
-	MV->translate(0.6228, 0.1179, 0.1365);
-	MV->rotate(-glm::radians(theta), 0, 0, 1);
-	MV->translate(-0.6228, -0.1179, -0.1365);
-	glUniformMatrix4fv(prog->getUniform("MV"), 1, GL_FALSE, glm::value_ptr(MV->topMatrix()));
-	MV->popMatrix();
-	p2.draw(prog);
+	M->pushMatrix();
+	M->translate(0.6228, 0.1179, 0.1365);
+	M->rotate(-glm::radians(theta), 0, 0, 1);
+	M->translate(-0.6228, -0.1179, -0.1365);
+	shapes[1] = &p2;
+	transforms[1] = M->topMatrix();
+	M->popMatrix();
 
-	// Draw the body of the helicopter
-	MV->pushMatrix();
-	glUniformMatrix4fv(prog->getUniform("MV"), 1, GL_FALSE, glm::value_ptr(MV->topMatrix()));
-	MV->popMatrix();
-	b1.draw(prog);
-	b2.draw(prog);
-	MV->popMatrix();
+	// The body of the helicopter
+	shapes[2] = &b1;
+	transforms[2] = M->topMatrix();
+	shapes[3] = &b2;
+	transforms[3] = M->topMatrix();
+	M->popMatrix();
+}
+void Helicopter::draw(const std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> M, CommandList &list, const FrameTime &time) {
+	const Shape *shapes[PARTS];
+	glm::mat4 transforms[PARTS];
+	getParts(M, time, shapes, transforms);
+	for (int i = 0; i < PARTS; i++) {
+		list.submit(0, prog, shapes[i], transforms[i]);
+	}
 }
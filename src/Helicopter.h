@@ -8,15 +8,27 @@
 #include "MatrixStack.h"
 #include "Shape.h"
 
+class CommandList;
+class JobSystem;
+class MeshArena;
+struct FrameTime;
+
 class Helicopter {
 public:
 	Helicopter();
 	~Helicopter();
-	void init(std::string DIR, std::string body1, std::string body2, std::string prop1, std::string prop2);
+	// Meshes are loaded in parallel, then uploaded on the calling (GL) thread
+	void init(std::shared_ptr<JobSystem> jobs, std::string DIR, std::string body1, std::string body2, std::string prop1, std::string prop2);
+	// init() without the upload, for rendering without GL
+	void load(std::shared_ptr<JobSystem> jobs, std::string DIR, std::string body1, std::string body2, std::string prop1, std::string prop2);
+	// Adds the parts to a shared arena for indirect drawing
+	void addMeshes(MeshArena &arena) const;
 	void propRotate(bool rotate);
-	void draw(const std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> MV);
+	void draw(const std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> M, CommandList &list, const FrameTime &time);
+	// The shapes of the helicopter and their transforms under M
+	enum { PARTS = 4 };
+	void getParts(std::shared_ptr<MatrixStack> M, const FrameTime &time, const Shape *shapes[PARTS], glm::mat4 transforms[PARTS]) const;
 private:
-	double t;
 	bool rotate_prop;
 	Shape b1;
 	Shape b2;
@@ -0,0 +1,148 @@
+#include "InputLog.h"
+
+#include <cstring>
+#include <iostream>
+
+#include "FrameClock.h"
+
+using namespace std;
+
+static const char MAGIC[4] = { 'A', '5', 'I', 'N' };
+static const size_t RECORD_SIZE = 28;
+
+InputLog::InputLog() :
+	file(NULL),
+	replaying(false),
+	width(0),
+	height(0),
+	frame(0),
+	cursor(0),
+	frameCount(0)
+{
+	
+}
+
+InputLog::~InputLog()
+{
+	close();
+}
+
+bool InputLog::startRecording(const string &fileName, int width, int height)
+{
+	close();
+	file = fopen(fileName.c_str(), "wb");
+	if(file == NULL) {
+		cerr << "Cannot write " << fileName << endl;
+		return false;
+	}
+	this->width = width;
+	this->height = height;
+	uint32_t header[3] = { VERSION, (uint32_t)width, (uint32_t)height };
+	fwrite(MAGIC, 1, sizeof(MAGIC), file);
+	fwrite(header, sizeof(uint32_t), 3, file);
+	frame = 0;
+	return true;
+}
+
+bool InputLog::startReplay(const string &fileName)
+{
+	close();
+	FILE *fp = fopen(fileName.c_str(), "rb");
+	if(fp == NULL) {
+		cerr << "Cannot read " << fileName << endl;
+		return false;
+	}
+	char magic[4];
+	uint32_t header[3];
+	if(fread(magic, 1, sizeof(magic), fp) != sizeof(magic) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+	   fread(header, sizeof(uint32_t), 3, fp) != 3 || header[0] != VERSION) {
+		cerr << fileName << " is not an input log" << endl;
+		fclose(fp);
+		return false;
+	}
+	width = header[1];
+	height = header[2];
+	
+	events.clear();
+	frameCount = 0;
+	char record[RECORD_SIZE];
+	while(fread(record, 1, RECORD_SIZE, fp) == RECORD_SIZE) {
+		Event e;
+		memcpy(&e.frame, record, 4);
+		e.type = record[4];
+		e.action = record[5];
+		memcpy(&e.mods, record + 6, 2);
+		memcpy(&e.code, record + 8, 4);
+		memcpy(&e.x, record + 12, 8);
+		memcpy(&e.y, record + 20, 8);
+		if(e.type == FRAME) {
+			frameCount = e.frame + 1;
+		}
+		events.push_back(e);
+	}
+	fclose(fp);
+	cursor = 0;
+	replaying = true;
+	return true;
+}
+
+void InputLog::close()
+{
+	if(file) {
+		fclose(file);
+		file = NULL;
+	}
+	replaying = false;
+	events.clear();
+}
+
+void InputLog::beginFrame(const FrameTime &time)
+{
+	if(!file) {
+		return;
+	}
+	// Events polled after this frame is rendered take effect in the next one
+	frame = (uint32_t)time.frame;
+	add(FRAME, 0, 0, 0, time.t);
+	frame = (uint32_t)time.frame + 1;
+}
+
+void InputLog::add(int type, int code, int action, int mods, double x, double y)
+{
+	if(!file) {
+		return;
+	}
+	char record[RECORD_SIZE];
+	uint16_t m = (uint16_t)mods;
+	int32_t c = code;
+	memcpy(record, &frame, 4);
+	record[4] = (char)type;
+	record[5] = (char)action;
+	memcpy(record + 6, &m, 2);
+	memcpy(record + 8, &c, 4);
+	memcpy(record + 12, &x, 8);
+	memcpy(record + 20, &y, 8);
+	fwrite(record, 1, RECORD_SIZE, file);
+}
+
+bool InputLog::next(long frame, Event &event)
+{
+	while(cursor < events.size() && events[cursor].frame <= frame) {
+		event = events[cursor++];
+		if(event.type != FRAME) {
+			return true;
+		}
+	}
+	return false;
+}
+
+vector<double> InputLog::getFrameTimes() const
+{
+	vector<double> times;
+	for(size_t i = 0; i < events.size(); ++i) {
+		if(events[i].type == FRAME) {
+			times.push_back(events[i].x);
+		}
+	}
+	return times;
+}
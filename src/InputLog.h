@@ -0,0 +1,86 @@
+#pragma  once
+#ifndef __InputLog__
+#define __InputLog__
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+struct FrameTime;
+
+/**
+ * Recording and replay of user input, so interactive sessions can be rerun
+ * exactly (e.g. as benchmarks)
+ * - While recording, every input event is written with the index of the
+ *   frame it first affects, and every frame with its time.
+ * - While replaying, next() hands out the events of a frame, to be applied
+ *   before that frame is rendered, and getFrameTimes() gives the recorded
+ *   clock (see FrameClock::setScript()).
+ *
+ * File layout (little endian):
+ *   "A5IN", uint32 version, uint32 width, uint32 height (window size)
+ *   records of 28 bytes: uint32 frame, uint8 type, uint8 action,
+ *   uint16 mods, int32 code, double x, double y
+ * FRAME records hold the frame time in x.
+ */
+class InputLog
+{
+public:
+	enum {
+		VERSION = 1
+	};
+	
+	enum Type {
+		FRAME = 0,
+		KEY,    // code = key
+		CHAR,   // code = code point
+		CURSOR, // x, y; action = 1 while the left button is down
+		BUTTON  // code = button, x, y = cursor
+	};
+	
+	struct Event
+	{
+		Event() : frame(0), type(FRAME), action(0), mods(0), code(0), x(0.0), y(0.0) {}
+		uint32_t frame;
+		uint8_t type;
+		uint8_t action;
+		uint16_t mods;
+		int32_t code;
+		double x;
+		double y;
+	};
+	
+	InputLog();
+	virtual ~InputLog();
+	
+	bool startRecording(const std::string &fileName, int width, int height);
+	bool startReplay(const std::string &fileName);
+	void close();
+	bool isRecording() const { return file != NULL; }
+	bool isReplaying() const { return replaying; }
+	
+	// Recording: call once per frame, before its input is applied
+	void beginFrame(const FrameTime &time);
+	void add(int type, int code, int action = 0, int mods = 0, double x = 0.0, double y = 0.0);
+	
+	// Replay: the next event of the given frame, in recorded order
+	bool next(long frame, Event &event);
+	// Replay: true once all the recorded frames have been played
+	bool isFinished(long frame) const { return frame >= frameCount; }
+	std::vector<double> getFrameTimes() const;
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	
+private:
+	FILE *file; // while recording
+	bool replaying;
+	int width;
+	int height;
+	uint32_t frame; // frame the recorded events apply to
+	std::vector<Event> events; // while replaying
+	size_t cursor;
+	long frameCount;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "InstanceCuller.h"
+
+#include <cassert>
+#include <cstddef>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GLSL.h"
+#include "Program.h"
+#include "Trace.h"
+
+using namespace std;
+
+static const int U_PLANES = Program::uniformHandle("uPlanes");
+static const int U_RADIUS = Program::uniformHandle("uRadius");
+static const int U_COUNT = Program::uniformHandle("uCount");
+
+InstanceCuller::InstanceCuller() :
+	maxInstances(0),
+	visibleBufID(0),
+	commandBufID(0)
+{
+	
+}
+
+InstanceCuller::~InstanceCuller()
+{
+	
+}
+
+bool InstanceCuller::isSupported()
+{
+	return GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object && GLEW_ARB_draw_indirect;
+}
+
+void InstanceCuller::extractPlanes(const glm::mat4 &PV, glm::vec4 planes[6])
+{
+	// Rows of PV (glm is column major)
+	glm::vec4 rows[4];
+	for(int i = 0; i < 4; ++i) {
+		rows[i] = glm::vec4(PV[0][i], PV[1][i], PV[2][i], PV[3][i]);
+	}
+	for(int i = 0; i < 3; ++i) {
+		planes[2*i] = rows[3] + rows[i];
+		planes[2*i + 1] = rows[3] - rows[i];
+	}
+	for(int i = 0; i < 6; ++i) {
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+void InstanceCuller::init(shared_ptr<Program> prog, int maxInstances, const vector<int> &vertexCounts)
+{
+	this->prog = prog;
+	this->maxInstances = maxInstances;
+	prog->addUniform("uPlanes");
+	prog->addUniform("uRadius");
+	prog->addUniform("uCount");
+	
+	commands.resize(vertexCounts.size());
+	for(size_t i = 0; i < commands.size(); ++i) {
+		commands[i].count = vertexCounts[i];
+		commands[i].instanceCount = 0;
+		commands[i].first = 0;
+		commands[i].baseInstance = 0;
+	}
+	
+	// Both buffers are only written by the GPU after this
+	glGenBuffers(1, &visibleBufID);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, visibleBufID);
+	glBufferData(GL_COPY_WRITE_BUFFER, 2*maxInstances*sizeof(glm::vec4), NULL, GL_DYNAMIC_COPY);
+	glGenBuffers(1, &commandBufID);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, commandBufID);
+	glBufferData(GL_COPY_WRITE_BUFFER, commands.size()*sizeof(DrawCommand), &commands[0], GL_DYNAMIC_COPY);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	GLSL::checkError(GET_FILE_LINE);
+}
+
+void InstanceCuller::cull(GLuint buffer, GLintptr offset, int count, const glm::mat4 &PV, float radius)
+{
+	TraceScope trace("InstanceCuller::cull");
+	assert(count <= maxInstances);
+	// Start from no visible instances
+	glBindBuffer(GL_COPY_WRITE_BUFFER, commandBufID);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, commands.size()*sizeof(DrawCommand), &commands[0]);
+	
+	glm::vec4 planes[6];
+	extractPlanes(PV, planes);
+	prog->bind();
+	glUniform4fv(prog->getUniform(U_PLANES), 6, glm::value_ptr(planes[0]));
+	glUniform1f(prog->getUniform(U_RADIUS), radius);
+	glUniform1ui(prog->getUniform(U_COUNT), count);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, buffer, offset, 2*count*sizeof(glm::vec4));
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visibleBufID);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBufID);
+	glDispatchCompute((count + GROUP_SIZE - 1)/GROUP_SIZE, 1, 1);
+	
+	// The shader counted into the first command; the others draw the same
+	// instances. The copies stay on the GPU.
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+	glBindBuffer(GL_COPY_READ_BUFFER, commandBufID);
+	for(size_t i = 1; i < commands.size(); ++i) {
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offsetof(DrawCommand, instanceCount),
+		                    i*sizeof(DrawCommand) + offsetof(DrawCommand, instanceCount), sizeof(GLuint));
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	GLSL::checkError(GET_FILE_LINE);
+}
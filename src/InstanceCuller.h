@@ -0,0 +1,65 @@
+#pragma  once
+#ifndef __InstanceCuller__
+#define __InstanceCuller__
+
+#include <memory>
+#include <vector>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+class Program;
+
+/**
+ * Frustum culling of instances on the GPU (compute shader, GL 4.3)
+ * - cull() tests each instance's bounding sphere against the frustum and
+ *   appends the visible ones to getInstanceBuffer(), in the same layout as
+ *   the input (vec4 position, vec4 rotation)
+ * - It also fills getCommandBuffer() with one DrawArraysIndirectCommand per
+ *   mesh, all drawing the visible instances, so the draw calls can be issued
+ *   without the CPU ever knowing how many there are
+ */
+class InstanceCuller
+{
+public:
+	struct DrawCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint first;
+		GLuint baseInstance;
+	};
+	
+	// Must match local_size_x in cull_comp.glsl
+	enum { GROUP_SIZE = 256 };
+	
+	InstanceCuller();
+	virtual ~InstanceCuller();
+	
+	static bool isSupported();
+	// Inward facing planes of the frustum of PV (left, right, bottom, top,
+	// near, far), normalized so their distances are in world units
+	static void extractPlanes(const glm::mat4 &PV, glm::vec4 planes[6]);
+	
+	// prog is the compute program built from cull_comp.glsl; vertexCounts
+	// has one entry per mesh drawn for each instance
+	void init(std::shared_ptr<Program> prog, int maxInstances, const std::vector<int> &vertexCounts);
+	// Culls count instances read from buffer at offset (aligned for a
+	// shader storage binding)
+	void cull(GLuint buffer, GLintptr offset, int count, const glm::mat4 &PV, float radius);
+	
+	GLuint getInstanceBuffer() const { return visibleBufID; }
+	GLuint getCommandBuffer() const { return commandBufID; }
+	
+private:
+	std::shared_ptr<Program> prog;
+	int maxInstances;
+	std::vector<DrawCommand> commands; // with instanceCount 0, reset every cull
+	GLuint visibleBufID;
+	GLuint commandBufID;
+};
+
+#endif
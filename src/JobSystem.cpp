@@ -0,0 +1,219 @@
+#include "JobSystem.h"
+
+#include <cassert>
+
+using namespace std;
+
+// Worker and attached threads know their system and index; any other
+// thread is thread 0
+static thread_local const JobSystem *tlsSystem = NULL;
+static thread_local int tlsIndex = 0;
+
+JobSystem::JobSystem(int count, int externals) :
+	queued(0),
+	quit(false)
+{
+	if(count <= 0) {
+		count = (int)thread::hardware_concurrency();
+	}
+	if(count <= 0) {
+		count = 1;
+	}
+	// Indices: 0 for the main thread, then the workers, then the other
+	// outside threads
+	attached = count;
+	externals = max(externals, 1);
+	for(int i = 0; i < count + externals - 1; ++i) {
+		Queue *queue = new Queue();
+		queue->ring = vector<Job>(MAX_JOBS);
+		queue->next = 0;
+		queues.push_back(queue);
+	}
+	for(int i = 1; i < count; ++i) {
+		threads.push_back(thread(&JobSystem::loop, this, i));
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	quit = true;
+	{
+		lock_guard<mutex> lock(sleepMutex);
+	}
+	wake.notify_all();
+	for(size_t i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+	for(size_t i = 0; i < queues.size(); ++i) {
+		delete queues[i];
+	}
+}
+
+int JobSystem::getThreadIndex() const
+{
+	return tlsSystem == this ? tlsIndex : 0;
+}
+
+void JobSystem::attachThread()
+{
+	int index = attached++;
+	assert(index < getCount() && "more outside threads than the system was created for");
+	tlsSystem = this;
+	tlsIndex = index;
+}
+
+JobSystem::Job *JobSystem::create(const function<void()> &work, Job *parent)
+{
+	Job *job = tryCreate(work, parent);
+	assert(job && "more than MAX_JOBS unfinished jobs");
+	return job;
+}
+
+JobSystem::Job *JobSystem::tryCreate(const function<void()> &work, Job *parent)
+{
+	// Only the owning thread allocates from its ring. pop() runs the newest
+	// jobs first, so the oldest can outlive a whole turn of the ring: skip
+	// the slots they still hold.
+	Queue *queue = queues[getThreadIndex()];
+	for(int i = 0; i < MAX_JOBS; ++i) {
+		Job *job = &queue->ring[queue->next++ % MAX_JOBS];
+		if(job->unfinished == 0) {
+			job->work = work;
+			job->parent = parent;
+			job->unfinished = 1;
+			if(parent) {
+				++parent->unfinished;
+			}
+			return job;
+		}
+	}
+	return NULL;
+}
+
+void JobSystem::run(Job *job)
+{
+	Queue *queue = queues[getThreadIndex()];
+	{
+		lock_guard<mutex> lock(queue->m);
+		queue->jobs.push_back(job);
+	}
+	++queued;
+	// Taking the lock orders the increment with a worker about to sleep
+	{
+		lock_guard<mutex> lock(sleepMutex);
+	}
+	wake.notify_one();
+}
+
+void JobSystem::wait(const Job *job)
+{
+	int index = getThreadIndex();
+	while(job->unfinished > 0) {
+		Job *next = pop(index);
+		if(!next) {
+			next = steal(index);
+		}
+		if(next) {
+			execute(next);
+		} else {
+			this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::parallelFor(int n, int grain, const RangeFunction &fn)
+{
+	if(n <= 0) {
+		return;
+	}
+	if(grain <= 0) {
+		grain = max(1, n/(4*getCount()));
+	}
+	Job *root = create(function<void()>());
+	split(root, 0, n, grain, &fn);
+	finish(root);
+	wait(root);
+}
+
+void JobSystem::split(Job *parent, int begin, int end, int grain, const RangeFunction *fn)
+{
+	// Halve the range, leaving the upper half for thieves, until it is small
+	// enough to run here
+	while(end - begin > grain) {
+		int mid = begin + (end - begin)/2;
+		int b = mid;
+		Job *job = tryCreate([this, parent, b, end, grain, fn]() { split(parent, b, end, grain, fn); }, parent);
+		if(job) {
+			run(job);
+		} else {
+			// Every slot is busy: do the upper half here rather than lose it
+			split(parent, b, end, grain, fn);
+		}
+		end = mid;
+	}
+	(*fn)(getThreadIndex(), begin, end);
+}
+
+JobSystem::Job *JobSystem::pop(int index)
+{
+	Queue *queue = queues[index];
+	lock_guard<mutex> lock(queue->m);
+	if(queue->jobs.empty()) {
+		return NULL;
+	}
+	Job *job = queue->jobs.back();
+	queue->jobs.pop_back();
+	--queued;
+	return job;
+}
+
+JobSystem::Job *JobSystem::steal(int index)
+{
+	int count = getCount();
+	for(int i = 1; i < count; ++i) {
+		Queue *queue = queues[(index + i) % count];
+		lock_guard<mutex> lock(queue->m);
+		if(!queue->jobs.empty()) {
+			Job *job = queue->jobs.front();
+			queue->jobs.pop_front();
+			--queued;
+			return job;
+		}
+	}
+	return NULL;
+}
+
+void JobSystem::execute(Job *job)
+{
+	if(job->work) {
+		job->work();
+	}
+	finish(job);
+}
+
+void JobSystem::finish(Job *job)
+{
+	// Read the parent first: once unfinished reaches 0 the slot may be reused
+	Job *parent = job->parent;
+	if(--job->unfinished == 0 && parent) {
+		finish(parent);
+	}
+}
+
+void JobSystem::loop(int index)
+{
+	tlsSystem = this;
+	tlsIndex = index;
+	while(!quit) {
+		Job *job = pop(index);
+		if(!job) {
+			job = steal(index);
+		}
+		if(job) {
+			execute(job);
+			continue;
+		}
+		unique_lock<mutex> lock(sleepMutex);
+		wake.wait(lock, [this]{ return quit || queued > 0; });
+	}
+}
@@ -0,0 +1,96 @@
+#pragma  once
+#ifndef __JobSystem__
+#define __JobSystem__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Work-stealing job scheduler
+ * - Every thread has its own deque. A thread pushes and pops jobs at the
+ *   back of its own deque (newest first, which keeps caches warm) and idle
+ *   threads steal from the front of the others (oldest, i.e. largest, work).
+ * - A job created with a parent keeps the parent unfinished until the child
+ *   is done, so wait() on the parent waits for the whole tree.
+ * - wait() does not block: the waiting thread runs jobs until its job is
+ *   done.
+ * - Thread 0 is the thread that uses the system from outside (the main
+ *   thread). Any other outside thread that creates, runs or waits for jobs
+ *   must call attachThread() first to get its own deque. Jobs themselves may
+ *   create, run and wait for more jobs.
+ * - Jobs come from a ring of MAX_JOBS per thread, so no more than that many
+ *   jobs created by one thread may be unfinished at a time. parallelFor()
+ *   keeps to this itself by running a range in place when its thread's ring
+ *   is full. Jobs never touch GL.
+ */
+class JobSystem
+{
+public:
+	enum {
+		MAX_JOBS = 4096
+	};
+	
+	struct Job;
+	// Body of a parallelFor(): fn(thread, begin, end)
+	typedef std::function<void(int, int, int)> RangeFunction;
+	
+	// count = 0 uses one thread per hardware thread, including the main
+	// thread; externals is the number of outside threads (main included)
+	JobSystem(int count = 0, int externals = 1);
+	virtual ~JobSystem();
+	
+	// Number of thread indices: workers and outside threads
+	int getCount() const { return (int)queues.size(); }
+	// Index of the calling thread (0 for the main thread)
+	int getThreadIndex() const;
+	// Gives the calling outside thread its own index and deque
+	void attachThread();
+	
+	Job *create(const std::function<void()> &work, Job *parent = NULL);
+	void run(Job *job);
+	void wait(const Job *job);
+	// Runs fn over [0, n), split recursively into ranges of at most grain
+	// items (grain <= 0 picks a few ranges per thread), and waits for it
+	void parallelFor(int n, int grain, const RangeFunction &fn);
+	
+	struct Job
+	{
+		Job() : parent(NULL), unfinished(0) {}
+		std::function<void()> work;
+		Job *parent;
+		std::atomic<int> unfinished; // 1 for the job itself + unfinished children
+	};
+	
+private:
+	struct Queue
+	{
+		std::mutex m;
+		std::deque<Job *> jobs;
+		std::vector<Job> ring;
+		unsigned next;
+	};
+	
+	void loop(int index);
+	Job *pop(int index);
+	Job *steal(int index);
+	void execute(Job *job);
+	void finish(Job *job);
+	// create() that returns NULL instead of asserting when the ring is full
+	Job *tryCreate(const std::function<void()> &work, Job *parent);
+	void split(Job *parent, int begin, int end, int grain, const RangeFunction *fn);
+	
+	std::vector<Queue *> queues;
+	std::vector<std::thread> threads;
+	std::atomic<int> attached; // next index for attachThread()
+	std::atomic<int> queued; // jobs sitting in any deque
+	std::atomic<bool> quit;
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+};
+
+#endif
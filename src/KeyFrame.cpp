@@ -64,10 +64,13 @@ void KeyFrame::setRot(float degrees, float x, float y, float z) {
 glm::quat KeyFrame::getRot() {
 	return rot;
 }
-void KeyFrame::drawKeyFrame(const std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> MV) {
-	MV->pushMatrix();
-	MV->translate(pos);
-	MV->multMatrix(glm::toMat4(rot));
-	H.draw(prog, MV);
-	MV->popMatrix();
+void KeyFrame::setHelicopter(std::shared_ptr<Helicopter> h) {
+	H = *h;
+}
+void KeyFrame::drawKeyFrame(const std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> M, CommandList &list, const FrameTime &time) {
+	M->pushMatrix();
+	M->translate(pos);
+	M->multMatrix(glm::toMat4(rot));
+	H.draw(prog, M, list, time);
+	M->popMatrix();
 }
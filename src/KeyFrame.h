@@ -24,7 +24,8 @@ public:
 	void setRot(float degrees, glm::vec3 axis);
 	void setRot(float degrees, float x, float y, float z);
 	glm::quat getRot();
-	void drawKeyFrame(const std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> MV);
+	void setHelicopter(std::shared_ptr<Helicopter> h);
+	void drawKeyFrame(const std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> M, CommandList &list, const FrameTime &time);
 	
 private:
 	glm::vec3 pos;
@@ -2,14 +2,117 @@
 
 #include <stdio.h>
 #include <cassert>
+#include <cmath>
 #include <vector>
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 
+// MATRIXSTACK_SIMD (see CMakeLists.txt) replaces the generic 4x4 products
+// with affine special cases, using SSE for the column arithmetic if available.
+#if defined(MATRIXSTACK_SIMD) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define MATRIXSTACK_SSE
+#include <xmmintrin.h>
+#endif
+
 using namespace std;
 
+#ifdef MATRIXSTACK_SIMD
+
+// out = a*x + b*y + c*z + d*w, where a, b, c, d are matrix columns.
+// out may alias any of the inputs.
+static inline void combineColumns(float *out, const float *a, const float *b, const float *c, const float *d,
+                                  float x, float y, float z, float w)
+{
+#ifdef MATRIXSTACK_SSE
+	__m128 r = _mm_mul_ps(_mm_loadu_ps(a), _mm_set1_ps(x));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(b), _mm_set1_ps(y)));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(c), _mm_set1_ps(z)));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(d), _mm_set1_ps(w)));
+	_mm_storeu_ps(out, r);
+#else
+	float r[4];
+	for(int i = 0; i < 4; ++i) {
+		r[i] = a[i]*x + b[i]*y + c[i]*z + d[i]*w;
+	}
+	for(int i = 0; i < 4; ++i) {
+		out[i] = r[i];
+	}
+#endif
+}
+
+// out = a*x + b*y + c*z
+static inline void combineColumns(float *out, const float *a, const float *b, const float *c,
+                                  float x, float y, float z)
+{
+#ifdef MATRIXSTACK_SSE
+	__m128 r = _mm_mul_ps(_mm_loadu_ps(a), _mm_set1_ps(x));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(b), _mm_set1_ps(y)));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(c), _mm_set1_ps(z)));
+	_mm_storeu_ps(out, r);
+#else
+	float r[4];
+	for(int i = 0; i < 4; ++i) {
+		r[i] = a[i]*x + b[i]*y + c[i]*z;
+	}
+	for(int i = 0; i < 4; ++i) {
+		out[i] = r[i];
+	}
+#endif
+}
+
+// top = top * T, where T is a pure translation: only the last column changes.
+static void affineTranslate(glm::mat4 &top, const glm::vec3 &t)
+{
+	float *m = &top[0][0];
+	combineColumns(m + 12, m, m + 4, m + 8, m + 12, t.x, t.y, t.z, 1.0f);
+}
+
+// top = top * S, where S is diagonal: the first three columns are scaled.
+static void affineScale(glm::mat4 &top, const glm::vec3 &s)
+{
+	top[0] *= s.x;
+	top[1] *= s.y;
+	top[2] *= s.z;
+}
+
+// top = top * R, where R is a rotation: the upper 3x3 block of R mixes the
+// first three columns and the last column is left untouched.
+static void affineRotate(glm::mat4 &top, float angle, const glm::vec3 &axis)
+{
+	const glm::vec3 a = glm::normalize(axis);
+	const float c = cos(angle);
+	const float s = sin(angle);
+	const float k = 1.0f - c;
+	// Columns of the rotation matrix (same as glm::rotate)
+	const float r0[3] = { c + k*a.x*a.x, k*a.x*a.y + s*a.z, k*a.x*a.z - s*a.y };
+	const float r1[3] = { k*a.y*a.x - s*a.z, c + k*a.y*a.y, k*a.y*a.z + s*a.x };
+	const float r2[3] = { k*a.z*a.x + s*a.y, k*a.z*a.y - s*a.x, c + k*a.z*a.z };
+	float *m = &top[0][0];
+	float c0[4], c1[4];
+	combineColumns(c0, m, m + 4, m + 8, r0[0], r0[1], r0[2]);
+	combineColumns(c1, m, m + 4, m + 8, r1[0], r1[1], r1[2]);
+	combineColumns(m + 8, m, m + 4, m + 8, r2[0], r2[1], r2[2]);
+	for(int i = 0; i < 4; ++i) {
+		m[i] = c0[i];
+		m[4 + i] = c1[i];
+	}
+}
+
+// top = top * B, general 4x4 case
+static void multiply(glm::mat4 &top, const glm::mat4 &B)
+{
+	const glm::mat4 A = top;
+	const float *a = &A[0][0];
+	float *m = &top[0][0];
+	for(int j = 0; j < 4; ++j) {
+		combineColumns(m + 4*j, a, a + 4, a + 8, a + 12, B[j][0], B[j][1], B[j][2], B[j][3]);
+	}
+}
+
+#endif
+
 MatrixStack::MatrixStack()
 {
 	mstack = make_shared< stack<glm::mat4> >();
@@ -44,7 +147,11 @@ void MatrixStack::loadIdentity()
 void MatrixStack::translate(const glm::vec3 &t)
 {
 	glm::mat4 &top = mstack->top();
+#ifdef MATRIXSTACK_SIMD
+	affineTranslate(top, t);
+#else
 	top *= glm::translate(t);
+#endif
 }
 
 void MatrixStack::translate(float x, float y, float z)
@@ -55,7 +162,11 @@ void MatrixStack::translate(float x, float y, float z)
 void MatrixStack::scale(const glm::vec3 &s)
 {
 	glm::mat4 &top = mstack->top();
+#ifdef MATRIXSTACK_SIMD
+	affineScale(top, s);
+#else
 	top *= glm::scale(s);
+#endif
 }
 
 void MatrixStack::scale(float x, float y, float z)
@@ -71,7 +182,11 @@ void MatrixStack::scale(float s)
 void MatrixStack::rotate(float angle, const glm::vec3 &axis)
 {
 	glm::mat4 &top = mstack->top();
+#ifdef MATRIXSTACK_SIMD
+	affineRotate(top, angle, axis);
+#else
 	top *= glm::rotate(angle, axis);
+#endif
 }
 
 void MatrixStack::rotate(float angle, float x, float y, float z)
@@ -82,7 +197,11 @@ void MatrixStack::rotate(float angle, float x, float y, float z)
 void MatrixStack::multMatrix(const glm::mat4 &matrix)
 {
 	glm::mat4 &top = mstack->top();
+#ifdef MATRIXSTACK_SIMD
+	multiply(top, matrix);
+#else
 	top *= matrix;
+#endif
 }
 
 const glm::mat4 &MatrixStack::topMatrix() const
@@ -0,0 +1,120 @@
+#include "MeshArena.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "GLSL.h"
+#include "GLState.h"
+#include "Program.h"
+#include "Shape.h"
+
+using namespace std;
+
+static const int A_POS = Program::attributeHandle("aPos");
+static const int A_NOR = Program::attributeHandle("aNor");
+
+// Vertices are welded when position and normal match exactly
+struct WeldKey
+{
+	float v[6];
+	bool operator<(const WeldKey &other) const { return memcmp(v, other.v, sizeof(v)) < 0; }
+};
+
+MeshArena::MeshArena() :
+	posBufID(0),
+	norBufID(0),
+	indexBufID(0)
+{
+	
+}
+
+MeshArena::~MeshArena()
+{
+	
+}
+
+bool MeshArena::isSupported()
+{
+	return GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance && GLEW_ARB_instanced_arrays;
+}
+
+int MeshArena::add(const Shape &shape)
+{
+	map<unsigned, int>::const_iterator found = shapeMeshes.find(shape.getID());
+	if(found != shapeMeshes.end()) {
+		return found->second;
+	}
+	const vector<float> &pos = shape.getPosBuf();
+	const vector<float> &nor = shape.getNorBuf();
+	assert(nor.size() == pos.size());
+	
+	Mesh mesh;
+	mesh.count = (GLuint)pos.size()/3;
+	mesh.firstIndex = (GLuint)indices.size();
+	mesh.baseVertex = (GLint)posBuf.size()/3;
+	map<WeldKey, GLuint> welded;
+	for(size_t i = 0; i < pos.size(); i += 3) {
+		WeldKey key;
+		memcpy(key.v, &pos[i], 3*sizeof(float));
+		memcpy(key.v + 3, &nor[i], 3*sizeof(float));
+		map<WeldKey, GLuint>::iterator it = welded.find(key);
+		if(it == welded.end()) {
+			// Indices are relative to the mesh's base vertex
+			it = welded.insert(make_pair(key, (GLuint)(posBuf.size()/3 - mesh.baseVertex))).first;
+			posBuf.insert(posBuf.end(), key.v, key.v + 3);
+			norBuf.insert(norBuf.end(), key.v + 3, key.v + 6);
+		}
+		indices.push_back(it->second);
+	}
+	meshes.push_back(mesh);
+	shapeMeshes[shape.getID()] = (int)meshes.size() - 1;
+	return (int)meshes.size() - 1;
+}
+
+void MeshArena::init()
+{
+	glGenBuffers(1, &posBufID);
+	GLState::bindArrayBuffer(posBufID);
+	glBufferData(GL_ARRAY_BUFFER, posBuf.size()*sizeof(float), &posBuf[0], GL_STATIC_DRAW);
+	
+	glGenBuffers(1, &norBufID);
+	GLState::bindArrayBuffer(norBufID);
+	glBufferData(GL_ARRAY_BUFFER, norBuf.size()*sizeof(float), &norBuf[0], GL_STATIC_DRAW);
+	
+	glGenBuffers(1, &indexBufID);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufID);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	
+	GLSL::checkError(GET_FILE_LINE);
+}
+
+int MeshArena::find(const Shape *shape) const
+{
+	map<unsigned, int>::const_iterator found = shapeMeshes.find(shape->getID());
+	return found == shapeMeshes.end() ? -1 : found->second;
+}
+
+void MeshArena::bind(const Program *prog, unsigned extraArrays) const
+{
+	int h_pos = prog->getAttribute(A_POS);
+	int h_nor = prog->getAttribute(A_NOR);
+	unsigned mask = extraArrays;
+	if(h_pos != -1) {
+		mask |= 1u << h_pos;
+	}
+	if(h_nor != -1) {
+		mask |= 1u << h_nor;
+	}
+	GLState::vertexAttribArrays(mask);
+	
+	if(h_pos != -1) {
+		GLState::bindArrayBuffer(posBufID);
+		glVertexAttribPointer(h_pos, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
+	}
+	if(h_nor != -1) {
+		GLState::bindArrayBuffer(norBufID);
+		glVertexAttribPointer(h_nor, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufID);
+}
@@ -0,0 +1,75 @@
+#pragma  once
+#ifndef __MeshArena__
+#define __MeshArena__
+
+#include <map>
+#include <vector>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+class Program;
+class Shape;
+
+/**
+ * Static meshes suballocated from one shared vertex and index buffer, so
+ * draws of different meshes need no rebinding and can be submitted together
+ * with glMultiDrawElementsIndirect.
+ * - add() welds the shape's duplicated vertices (Shape stores one vertex per
+ *   triangle corner) into indexed geometry; init() uploads everything once.
+ * - Meshes are looked up by Shape::getID(), so copies of a Shape find the
+ *   same mesh.
+ */
+class MeshArena
+{
+public:
+	// Layout of one glMultiDrawElementsIndirect command
+	struct DrawCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+	
+	struct Mesh
+	{
+		GLuint count;      // indices
+		GLuint firstIndex;
+		GLint baseVertex;
+	};
+	
+	MeshArena();
+	virtual ~MeshArena();
+	
+	// Multi-draw indirect with per-draw data selected by baseInstance
+	static bool isSupported();
+	
+	// Shapes must have normals; returns the mesh index
+	int add(const Shape &shape);
+	void init();
+	
+	// Mesh index of a shape, or -1 if it was not added
+	int find(const Shape *shape) const;
+	const Mesh &getMesh(int i) const { return meshes[i]; }
+	
+	// Binds the shared buffers (aPos, aNor and the index buffer); extraArrays
+	// as in Shape::bind()
+	void bind(const Program *prog, unsigned extraArrays = 0) const;
+	
+	int getVertexCount() const { return (int)posBuf.size()/3; }
+	int getIndexCount() const { return (int)indices.size(); }
+	
+private:
+	std::vector<Mesh> meshes;
+	std::map<unsigned, int> shapeMeshes; // Shape::getID() -> mesh
+	std::vector<float> posBuf;
+	std::vector<float> norBuf;
+	std::vector<GLuint> indices;
+	GLuint posBufID;
+	GLuint norBufID;
+	GLuint indexBufID;
+};
+
+#endif
@@ -0,0 +1,170 @@
+#include "Picker.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <memory>
+
+#include "FrameClock.h"
+#include "Helicopter.h"
+#include "MatrixStack.h"
+#include "Shape.h"
+#include "Trace.h"
+
+using namespace std;
+
+Picker::Picker() :
+	helicopter(NULL),
+	cpRadius(0.0f)
+{
+	
+}
+
+Picker::~Picker()
+{
+	
+}
+
+void Picker::setKeyFrames(const vector<glm::mat4> &poses, const Helicopter &helicopter)
+{
+	this->helicopter = &helicopter;
+	
+	// Sphere around the helicopter's origin holding every part at every
+	// propeller angle (whole degrees, see Helicopter::getParts()), so the
+	// boxes hold whatever the time
+	float radius = 0.0f;
+	auto M = make_shared<MatrixStack>();
+	for(int degree = 0; degree < 360; ++degree) {
+		FrameTime time;
+		time.t = (degree + 0.5)/360.0;
+		const Shape *shapes[Helicopter::PARTS];
+		glm::mat4 transforms[Helicopter::PARTS];
+		helicopter.getParts(M, time, shapes, transforms);
+		for(int i = 0; i < Helicopter::PARTS; ++i) {
+			shared_ptr<const Bvh> bvh = shapes[i]->getBvh();
+			if(!bvh || bvh->empty()) {
+				continue;
+			}
+			glm::vec3 lo = bvh->getMin();
+			glm::vec3 hi = bvh->getMax();
+			glm::vec3 center(transforms[i]*glm::vec4(0.5f*(lo + hi), 1.0f));
+			float extent = glm::length(glm::vec3(transforms[i]*glm::vec4(0.5f*(hi - lo), 0.0f)));
+			radius = max(radius, glm::length(center) + extent);
+		}
+	}
+	
+	inversePoses.resize(poses.size());
+	vector<glm::vec3> mins(poses.size()), maxs(poses.size());
+	for(size_t k = 0; k < poses.size(); ++k) {
+		inversePoses[k] = glm::inverse(poses[k]);
+		// Scaled poses stretch the sphere by at most their largest axis
+		float scale = max(glm::length(glm::vec3(poses[k][0])),
+		                  max(glm::length(glm::vec3(poses[k][1])), glm::length(glm::vec3(poses[k][2]))));
+		glm::vec3 p(poses[k][3]);
+		mins[k] = p - glm::vec3(scale*radius);
+		maxs[k] = p + glm::vec3(scale*radius);
+	}
+	keyframeBvh.build(mins, maxs);
+}
+
+void Picker::setControlPoints(const vector<glm::vec3> &cps, float radius)
+{
+	this->cps = cps;
+	cpRadius = radius;
+	vector<glm::vec3> mins(cps.size()), maxs(cps.size());
+	for(size_t i = 0; i < cps.size(); ++i) {
+		mins[i] = cps[i] - glm::vec3(radius);
+		maxs[i] = cps[i] + glm::vec3(radius);
+	}
+	cpBvh.build(mins, maxs);
+}
+
+void Picker::unproject(float x, float y, int width, int height, const glm::mat4 &P, const glm::mat4 &V,
+                       glm::vec3 &origin, glm::vec3 &dir)
+{
+	// Pixel centers to normalized device coordinates (y up), then back
+	// through the camera from the near to the far plane
+	float nx = 2.0f*x/width - 1.0f;
+	float ny = 1.0f - 2.0f*y/height;
+	glm::mat4 inv = glm::inverse(P*V);
+	glm::vec4 pn = inv*glm::vec4(nx, ny, -1.0f, 1.0f);
+	glm::vec4 pf = inv*glm::vec4(nx, ny, 1.0f, 1.0f);
+	origin = glm::vec3(pn)/pn.w;
+	dir = glm::normalize(glm::vec3(pf)/pf.w - origin);
+}
+
+bool Picker::pickKeyFrame(const glm::vec3 &origin, const glm::vec3 &dir, const FrameTime &time, Hit &hit) const
+{
+	TraceScope trace("Picker::pickKeyFrame");
+	if(!helicopter || keyframeBvh.empty()) {
+		return false;
+	}
+	const Shape *shapes[Helicopter::PARTS];
+	glm::mat4 inverseParts[Helicopter::PARTS];
+	glm::mat4 transforms[Helicopter::PARTS];
+	helicopter->getParts(make_shared<MatrixStack>(), time, shapes, transforms);
+	for(int i = 0; i < Helicopter::PARTS; ++i) {
+		inverseParts[i] = glm::inverse(transforms[i]);
+	}
+	
+	float tmax = FLT_MAX;
+	int best = -1;
+	keyframeBvh.intersect(origin, dir, tmax, [&](int k, float &t) {
+		// Into the keyframe's space, then into each part's. The direction is
+		// not renormalized, which keeps t the same.
+		glm::vec3 o(inversePoses[k]*glm::vec4(origin, 1.0f));
+		glm::vec3 d(inversePoses[k]*glm::vec4(dir, 0.0f));
+		for(int i = 0; i < Helicopter::PARTS; ++i) {
+			glm::vec3 po(inverseParts[i]*glm::vec4(o, 1.0f));
+			glm::vec3 pd(inverseParts[i]*glm::vec4(d, 0.0f));
+			// Equal hits (keyframes sharing a pose) go to the lower index
+			float tk = best >= 0 && k < best ? nextafter(t, FLT_MAX) : t;
+			if(shapes[i]->intersect(po, pd, tk)) {
+				t = tk;
+				best = k;
+			}
+		}
+	});
+	if(best < 0) {
+		return false;
+	}
+	hit.type = KEYFRAME;
+	hit.index = best;
+	hit.t = tmax;
+	hit.point = origin + tmax*dir;
+	return true;
+}
+
+bool Picker::pickControlPoint(const glm::vec3 &origin, const glm::vec3 &dir, Hit &hit) const
+{
+	float tmax = FLT_MAX;
+	int best = -1;
+	const float r2 = cpRadius*cpRadius;
+	const float dd = glm::dot(dir, dir);
+	cpBvh.intersect(origin, dir, tmax, [&](int i, float &t) {
+		// Nearer root of |origin + t*dir - cp|^2 = r^2
+		glm::vec3 oc = origin - cps[i];
+		float b = glm::dot(oc, dir);
+		float c = glm::dot(oc, oc) - r2;
+		float disc = b*b - dd*c;
+		if(disc < 0.0f) {
+			return;
+		}
+		float ti = (-b - sqrt(disc))/dd;
+		if(ti < 0.0f) {
+			ti = 0.0f; // starts inside
+		}
+		if(ti < t || (ti == t && i < best)) {
+			t = ti;
+			best = i;
+		}
+	});
+	if(best < 0) {
+		return false;
+	}
+	hit.type = CONTROL_POINT;
+	hit.index = best;
+	hit.t = tmax;
+	hit.point = origin + tmax*dir;
+	return true;
+}
@@ -0,0 +1,70 @@
+#pragma  once
+#ifndef __Picker__
+#define __Picker__
+
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "Bvh.h"
+
+class Helicopter;
+struct FrameTime;
+
+/**
+ * Selects keyframes and control points under the cursor
+ * - unproject() turns a cursor position into a world space ray through the
+ *   camera's matrices.
+ * - Keyframes: a BVH over a box around each keyframe's helicopter finds
+ *   the candidates, then the ray is moved into each part's object space and
+ *   cast against the part's triangle BVH (Shape::buildBvh()), so only real
+ *   hits on the mesh count.
+ * - Control points: a BVH over small spheres around the points.
+ * Rays are origin + t*dir; t is the same in every space the ray is moved
+ * to, so hits in different objects compare directly.
+ */
+class Picker
+{
+public:
+	enum Type {
+		NONE = -1,
+		KEYFRAME = 0,
+		CONTROL_POINT
+	};
+	
+	struct Hit
+	{
+		Hit() : type(NONE), index(-1), t(0.0f) {}
+		int type;
+		int index;       // keyframe or control point
+		float t;
+		glm::vec3 point; // world space
+	};
+	
+	Picker();
+	virtual ~Picker();
+	
+	// poses are the keyframes' model matrices; the helicopter's shapes must
+	// have their BVHs and stay alive
+	void setKeyFrames(const std::vector<glm::mat4> &poses, const Helicopter &helicopter);
+	void setControlPoints(const std::vector<glm::vec3> &cps, float radius);
+	
+	// Ray through window position (x, y) (pixels, y down, as GLFW reports
+	// the cursor) for the camera P*V
+	static void unproject(float x, float y, int width, int height, const glm::mat4 &P, const glm::mat4 &V,
+	                      glm::vec3 &origin, glm::vec3 &dir);
+	// Closest hit, if any; time places the propellers
+	bool pickKeyFrame(const glm::vec3 &origin, const glm::vec3 &dir, const FrameTime &time, Hit &hit) const;
+	bool pickControlPoint(const glm::vec3 &origin, const glm::vec3 &dir, Hit &hit) const;
+	
+private:
+	const Helicopter *helicopter;
+	std::vector<glm::mat4> inversePoses;
+	Bvh keyframeBvh;
+	std::vector<glm::vec3> cps;
+	float cpRadius;
+	Bvh cpBvh;
+};
+
+#endif
@@ -0,0 +1,183 @@
+#include "PoseTrack.h"
+
+#include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Trace.h"
+
+using namespace std;
+
+struct Header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t count;
+	float rate;
+};
+
+static const int FLOATS_PER_POSE = 7;
+
+PoseTrack::PoseTrack() :
+	records(NULL),
+	count(0),
+	rate(0.0),
+	mapping(NULL),
+	mappingSize(0)
+{
+	
+}
+
+PoseTrack::~PoseTrack()
+{
+	close();
+}
+
+bool PoseTrack::bake(const string &fileName, double duration, double rate, const PoseFunction &pose)
+{
+	TraceScope trace("PoseTrack::bake", fileName.c_str());
+	if(duration <= 0.0 || rate <= 0.0) {
+		cerr << "Nothing to bake" << endl;
+		return false;
+	}
+	FILE *fp = fopen(fileName.c_str(), "wb");
+	if(fp == NULL) {
+		cerr << "Cannot write " << fileName << endl;
+		return false;
+	}
+	Header header;
+	memcpy(header.magic, "A5PT", 4);
+	header.version = VERSION;
+	header.count = (uint32_t)ceil(duration*rate) + 1;
+	header.rate = (float)rate;
+	fwrite(&header, sizeof(header), 1, fp);
+	for(uint32_t i = 0; i < header.count; ++i) {
+		glm::vec3 p;
+		glm::quat q;
+		pose(i/rate, p, q);
+		float record[FLOATS_PER_POSE] = { p.x, p.y, p.z, q.x, q.y, q.z, q.w };
+		fwrite(record, sizeof(record), 1, fp);
+	}
+	bool ok = !ferror(fp);
+	fclose(fp);
+	if(!ok) {
+		cerr << "Error writing " << fileName << endl;
+	}
+	return ok;
+}
+
+bool PoseTrack::open(const string &fileName)
+{
+	close();
+	const char *data = NULL;
+	size_t size = 0;
+#ifndef _WIN32
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+	if(fd >= 0) {
+		struct stat st;
+		if(fstat(fd, &st) == 0 && st.st_size > 0) {
+			void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(m != MAP_FAILED) {
+				mapping = m;
+				mappingSize = st.st_size;
+				data = (const char *)m;
+				size = mappingSize;
+			}
+		}
+		::close(fd); // the mapping stays valid
+	}
+#endif
+	if(data == NULL) {
+		FILE *fp = fopen(fileName.c_str(), "rb");
+		if(fp == NULL) {
+			cerr << "Cannot open " << fileName << endl;
+			return false;
+		}
+		fseek(fp, 0, SEEK_END);
+		long length = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+		if(length > 0) {
+			buffer.resize(length);
+			buffer.resize(fread(&buffer[0], 1, length, fp));
+		}
+		fclose(fp);
+		data = buffer.empty() ? NULL : &buffer[0];
+		size = buffer.size();
+	}
+	
+	Header header;
+	if(size < sizeof(header)) {
+		cerr << fileName << " is not a pose track" << endl;
+		close();
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	if(memcmp(header.magic, "A5PT", 4) != 0 || header.version != VERSION || header.rate <= 0.0f ||
+	   header.count == 0 || size < sizeof(header) + (size_t)header.count*FLOATS_PER_POSE*sizeof(float)) {
+		cerr << fileName << " is not a pose track" << endl;
+		close();
+		return false;
+	}
+	records = (const float *)(data + sizeof(header));
+	count = header.count;
+	rate = header.rate;
+	return true;
+}
+
+void PoseTrack::close()
+{
+#ifndef _WIN32
+	if(mapping) {
+		munmap(mapping, mappingSize);
+	}
+#endif
+	mapping = NULL;
+	mappingSize = 0;
+	buffer.clear();
+	records = NULL;
+	count = 0;
+	rate = 0.0;
+}
+
+void PoseTrack::pose(double t, glm::vec3 &p, glm::quat &q) const
+{
+	if(count == 0) {
+		p = glm::vec3(0.0f);
+		q = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		return;
+	}
+	// Wrap into [0, duration) and split into a sample index and a fraction
+	double duration = getDuration();
+	double f = 0.0;
+	if(duration > 0.0) {
+		f = fmod(t, duration);
+		if(f < 0.0) {
+			f += duration;
+		}
+		f *= rate;
+	}
+	long i = min((long)f, count - 1);
+	long j = min(i + 1, count - 1);
+	float alpha = (float)(f - i);
+	const float *a = records + i*FLOATS_PER_POSE;
+	const float *b = records + j*FLOATS_PER_POSE;
+	
+	p = glm::mix(glm::vec3(a[0], a[1], a[2]), glm::vec3(b[0], b[1], b[2]), alpha);
+	
+	// nlerp along the shorter arc
+	glm::quat qa(a[6], a[3], a[4], a[5]);
+	glm::quat qb(b[6], b[3], b[4], b[5]);
+	if(glm::dot(qa, qb) < 0.0f) {
+		qb = -qb;
+	}
+	q = glm::normalize(qa*(1.0f - alpha) + qb*alpha);
+}
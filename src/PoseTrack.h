@@ -0,0 +1,60 @@
+#pragma  once
+#ifndef __PoseTrack__
+#define __PoseTrack__
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+/**
+ * Baked trajectory: poses (position and rotation) sampled at a fixed rate
+ * and stored in a binary file.
+ * - bake() samples any pose function offline.
+ * - open() maps the file into memory (POSIX; other platforms read it), so
+ *   very long flights cost nothing until the pages are touched.
+ * - pose() is O(1) for any time: lerp of the two nearest positions and
+ *   nlerp of their rotations. Time wraps around the length of the track.
+ *
+ * File layout (little endian):
+ *   "A5PT", uint32 version, uint32 count, float rate (Hz)
+ *   count x { float px, py, pz, qx, qy, qz, qw }
+ */
+class PoseTrack
+{
+public:
+	enum {
+		VERSION = 1
+	};
+	
+	// pose(t, p, q) returns the position and rotation at time t
+	typedef std::function<void(double, glm::vec3 &, glm::quat &)> PoseFunction;
+	
+	PoseTrack();
+	virtual ~PoseTrack();
+	
+	// Samples [0, duration] at rate Hz into fileName
+	static bool bake(const std::string &fileName, double duration, double rate, const PoseFunction &pose);
+	
+	bool open(const std::string &fileName);
+	void close();
+	bool isOpen() const { return records != NULL; }
+	long getCount() const { return count; }
+	double getRate() const { return rate; }
+	double getDuration() const { return count > 1 ? (count - 1)/rate : 0.0; }
+	
+	void pose(double t, glm::vec3 &p, glm::quat &q) const;
+	
+private:
+	const float *records; // 7 floats per pose
+	long count;
+	double rate;
+	void *mapping;     // mmap'ed file
+	size_t mappingSize;
+	std::vector<char> buffer; // file contents when it cannot be mapped
+};
+
+#endif
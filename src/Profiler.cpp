@@ -0,0 +1,158 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdio.h>
+
+#include "Trace.h"
+
+using namespace std;
+
+void Profiler::Samples::add(double sample)
+{
+	if(ms.size() < Profiler::WINDOW) {
+		ms.push_back(sample);
+	} else {
+		ms[next] = sample;
+	}
+	next = (next + 1) % Profiler::WINDOW;
+}
+
+Profiler::Profiler() :
+	frame(0),
+	timerQueries(false)
+{
+	
+}
+
+Profiler::~Profiler()
+{
+}
+
+int Profiler::addSection(const string &name, bool gpu)
+{
+	// Needs a current context; timer queries are core in GL 3.3
+	timerQueries = GLEW_ARB_timer_query || GLEW_VERSION_3_3;
+	Section section;
+	section.name = name;
+	section.gpu = gpu && timerQueries;
+	section.traceStart = -1;
+	for(int i = 0; i < LATENCY; ++i) {
+		section.queries[i] = 0;
+		section.pending[i] = false;
+	}
+	if(section.gpu) {
+		glGenQueries(LATENCY, section.queries);
+	}
+	sections.push_back(section);
+	return (int)sections.size() - 1;
+}
+
+void Profiler::begin(int id)
+{
+	Section &section = sections[id];
+	if(section.gpu) {
+		// Collect the query issued LATENCY frames ago before reusing it. If
+		// the GPU is still behind, the sample is dropped rather than waited on.
+		int slot = (int)(frame % LATENCY);
+		GLuint query = section.queries[slot];
+		if(section.pending[slot]) {
+			GLint available = 0;
+			glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if(available) {
+				GLuint64 ns = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+				section.gpuTimes.add(ns*1e-6);
+			}
+		}
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		section.pending[slot] = true;
+	}
+	section.traceStart = Trace::isEnabled() ? Trace::now() : -1;
+	section.start = chrono::steady_clock::now();
+}
+
+void Profiler::end(int id)
+{
+	Section &section = sections[id];
+	section.cpu.add(chrono::duration<double, milli>(chrono::steady_clock::now() - section.start).count());
+	if(section.traceStart >= 0) {
+		Trace::record(section.name.c_str(), section.traceStart, Trace::now());
+	}
+	if(section.gpu) {
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+}
+
+void Profiler::endFrame()
+{
+	++frame;
+}
+
+Profiler::Stats Profiler::computeStats(const Samples &samples)
+{
+	Stats stats;
+	if(samples.ms.empty()) {
+		return stats;
+	}
+	vector<double> sorted = samples.ms;
+	sort(sorted.begin(), sorted.end());
+	double sum = 0.0;
+	for(size_t i = 0; i < sorted.size(); ++i) {
+		sum += sorted[i];
+	}
+	stats.count = sorted.size();
+	stats.min = sorted.front();
+	stats.avg = sum / sorted.size();
+	stats.p99 = sorted[(size_t)(0.99*(sorted.size() - 1))];
+	return stats;
+}
+
+Profiler::Stats Profiler::getCPUStats(int id) const
+{
+	return computeStats(sections[id].cpu);
+}
+
+Profiler::Stats Profiler::getGPUStats(int id) const
+{
+	return computeStats(sections[id].gpuTimes);
+}
+
+void Profiler::print() const
+{
+	printf("%-12s %27s   %27s\n", "", "CPU ms (min/avg/p99)", "GPU ms (min/avg/p99)");
+	for(size_t i = 0; i < sections.size(); ++i) {
+		Stats cpu = getCPUStats((int)i);
+		printf("%-12s %8.3f %8.3f %8.3f   ", sections[i].name.c_str(), cpu.min, cpu.avg, cpu.p99);
+		if(sections[i].gpu) {
+			Stats gpu = getGPUStats((int)i);
+			printf("%8.3f %8.3f %8.3f\n", gpu.min, gpu.avg, gpu.p99);
+		} else {
+			printf("%27s\n", "-");
+		}
+	}
+}
+
+bool Profiler::writeJSON(const string &fileName) const
+{
+	FILE *fp = fopen(fileName.c_str(), "w");
+	if(fp == NULL) {
+		cerr << "Cannot write " << fileName << endl;
+		return false;
+	}
+	fprintf(fp, "{\n  \"frames\": %ld,\n  \"sections\": [\n", frame);
+	for(size_t i = 0; i < sections.size(); ++i) {
+		Stats cpu = getCPUStats((int)i);
+		fprintf(fp, "    {\"name\": \"%s\", \"cpu_ms\": {\"min\": %g, \"avg\": %g, \"p99\": %g, \"samples\": %zu}",
+		        sections[i].name.c_str(), cpu.min, cpu.avg, cpu.p99, cpu.count);
+		if(sections[i].gpu) {
+			Stats gpu = getGPUStats((int)i);
+			fprintf(fp, ", \"gpu_ms\": {\"min\": %g, \"avg\": %g, \"p99\": %g, \"samples\": %zu}",
+			        gpu.min, gpu.avg, gpu.p99, gpu.count);
+		}
+		fprintf(fp, "}%s\n", i + 1 < sections.size() ? "," : "");
+	}
+	fprintf(fp, "  ]\n}\n");
+	fclose(fp);
+	return true;
+}
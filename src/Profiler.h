@@ -0,0 +1,95 @@
+#pragma  once
+#ifndef __Profiler__
+#define __Profiler__
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+/**
+ * Per-pass CPU and GPU frame timings
+ * - Sections are registered once with addSection() and then timed every
+ *   frame with begin()/end() or a ProfileScope.
+ * - GPU time uses GL_TIME_ELAPSED queries kept in a small ring per section;
+ *   results are read LATENCY frames later, so the CPU never waits on the GPU.
+ *   Time-elapsed queries cannot nest, so GPU sections must not overlap.
+ * - The last WINDOW samples of each section are kept for min/avg/p99.
+ * - Each section is also recorded as a Trace event while tracing is enabled.
+ */
+class Profiler
+{
+public:
+	enum {
+		LATENCY = 4,
+		WINDOW = 256
+	};
+	
+	struct Stats
+	{
+		Stats() : min(0.0), avg(0.0), p99(0.0), count(0) {}
+		double min; // milliseconds
+		double avg;
+		double p99;
+		size_t count;
+	};
+	
+	Profiler();
+	virtual ~Profiler();
+	
+	// gpu: also time the section on the GPU (if timer queries are supported)
+	int addSection(const std::string &name, bool gpu);
+	void begin(int id);
+	void end(int id);
+	void endFrame();
+	
+	Stats getCPUStats(int id) const;
+	Stats getGPUStats(int id) const;
+	void print() const;
+	bool writeJSON(const std::string &fileName) const;
+	
+private:
+	struct Samples
+	{
+		Samples() : next(0) {}
+		void add(double ms);
+		std::vector<double> ms;
+		size_t next;
+	};
+	
+	struct Section
+	{
+		std::string name;
+		bool gpu;
+		GLuint queries[LATENCY];
+		bool pending[LATENCY];
+		std::chrono::steady_clock::time_point start;
+		long long traceStart;
+		Samples cpu;
+		Samples gpuTimes;
+	};
+	
+	static Stats computeStats(const Samples &samples);
+	
+	std::vector<Section> sections;
+	long frame;
+	bool timerQueries;
+};
+
+/**
+ * Times the enclosing block as a Profiler section
+ */
+class ProfileScope
+{
+public:
+	ProfileScope(Profiler &profiler, int id) : profiler(profiler), id(id) { profiler.begin(id); }
+	~ProfileScope() { profiler.end(id); }
+	
+private:
+	Profiler &profiler;
+	int id;
+};
+
+#endif
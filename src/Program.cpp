@@ -2,8 +2,12 @@
 
 #include <iostream>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
 
 #include "GLSL.h"
+#include "Trace.h"
+#include "GLState.h"
 
 using namespace std;
 
@@ -11,6 +15,8 @@ Program::Program() :
 	vShaderName(""),
 	fShaderName(""),
 	pid(0),
+	pendingPid(0),
+	compute(false),
 	verbose(true)
 {
 	
@@ -25,102 +31,413 @@ void Program::setShaderNames(const string &v, const string &f)
 {
 	vShaderName = v;
 	fShaderName = f;
+	compute = false;
+}
+
+void Program::setComputeShaderName(const string &c)
+{
+	vShaderName = c;
+	fShaderName = "";
+	compute = true;
+}
+
+// FNV-1a, used to key the binary cache on shader sources and driver
+static unsigned long long hashString(const char *str, unsigned long long h = 14695981039346656037ULL)
+{
+	for(; str && *str; ++str) {
+		h ^= (unsigned char)*str;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+string &Program::binaryCacheDir()
+{
+	static string dir;
+	return dir;
+}
+
+void Program::setBinaryCacheDir(const string &dir)
+{
+	binaryCacheDir() = dir;
+}
+
+string Program::binaryCacheName(const char *vshader, const char *fshader) const
+{
+	if(binaryCacheDir().empty() || !GLEW_ARB_get_program_binary) {
+		return "";
+	}
+	// The key covers both sources and the driver, since binaries are only
+	// valid for the driver that produced them.
+	unsigned long long h = hashString(vshader);
+	h = hashString("\n", h);
+	h = hashString(fshader, h);
+	h = hashString((const char *)glGetString(GL_VENDOR), h);
+	h = hashString((const char *)glGetString(GL_RENDERER), h);
+	h = hashString((const char *)glGetString(GL_VERSION), h);
+	char key[17];
+	snprintf(key, sizeof(key), "%016llx", h);
+	return binaryCacheDir() + "program_" + key + ".bin";
 }
 
 bool Program::init()
 {
-	GLint rc;
+	TraceScope trace("Program::init", vShaderName.c_str());
+	// Read shader sources
+	char *vshader = GLSL::textFileRead(vShaderName.c_str());
+	char *fshader = compute ? NULL : GLSL::textFileRead(fShaderName.c_str());
+	
+	// Try the binary cache first
+	string cacheName = binaryCacheName(vshader, fshader);
+	if(!cacheName.empty()) {
+		pid = loadBinary(cacheName);
+		if(pid) {
+			free(vshader);
+			free(fshader);
+			GLSL::checkError(GET_FILE_LINE);
+			return true;
+		}
+	}
 	
-	// Create shader handles
+	GLuint prog = beginBuild(vshader, fshader, !cacheName.empty());
+	free(vshader);
+	free(fshader);
+	if(!finishBuild(prog, isVerbose())) {
+		return false;
+	}
+	pid = prog;
+	if(!cacheName.empty()) {
+		saveBinary(cacheName);
+	}
+	
+	GLSL::checkError(GET_FILE_LINE);
+	return true;
+}
+
+void Program::beginReload()
+{
+	// A newer change supersedes a build that is still in flight
+	if(pendingPid) {
+		glDeleteProgram(pendingPid);
+		pendingPid = 0;
+	}
+	char *vshader = GLSL::textFileRead(vShaderName.c_str());
+	char *fshader = compute ? NULL : GLSL::textFileRead(fShaderName.c_str());
+	if(vshader && (fshader || compute)) {
+		pendingCacheName = binaryCacheName(vshader, fshader);
+		pendingPid = beginBuild(vshader, fshader, !pendingCacheName.empty());
+	}
+	free(vshader);
+	free(fshader);
+}
+
+bool Program::pollReload()
+{
+	if(!pendingPid || !isBuildComplete(pendingPid)) {
+		return false;
+	}
+	TraceScope trace("Program::reload", vShaderName.c_str());
+	GLuint prog = pendingPid;
+	pendingPid = 0;
+	// Always report reload errors, even if the program is not verbose
+	if(!finishBuild(prog, true)) {
+		cout << "Keeping previous program for " << vShaderName << " and " << fShaderName << endl;
+		return true;
+	}
+	
+	// Swap in the new program and re-resolve everything added to the old one.
+	// The old id may be reused by GL, so the state cache must not think it is
+	// still bound.
+	GLState::useProgram(0);
+	glDeleteProgram(pid);
+	pid = prog;
+	for(size_t h = 0; h < attributeNames.size(); ++h) {
+		if(!attributeNames[h].empty()) {
+			attributes[h] = glGetAttribLocation(pid, attributeNames[h].c_str());
+		}
+	}
+	for(size_t h = 0; h < uniformNames.size(); ++h) {
+		if(!uniformNames[h].empty()) {
+			uniforms[h] = glGetUniformLocation(pid, uniformNames[h].c_str());
+		}
+	}
+	for(size_t i = 0; i < uniformBlocks.size(); ++i) {
+		setUniformBlockBinding(uniformBlocks[i].first, uniformBlocks[i].second);
+	}
+	if(!pendingCacheName.empty()) {
+		saveBinary(pendingCacheName);
+	}
+	cout << "Reloaded " << vShaderName << " and " << fShaderName << endl;
+	GLSL::checkError(GET_FILE_LINE);
+	return true;
+}
+
+GLuint Program::beginBuild(const char *vshader, const char *fshader, bool retrievable) const
+{
+	// Compile and link without querying any status, so that drivers with
+	// KHR_parallel_shader_compile can do the work on their own threads.
+	if(compute) {
+		GLuint CS = glCreateShader(GL_COMPUTE_SHADER);
+		glShaderSource(CS, 1, &vshader, NULL);
+		glCompileShader(CS);
+		GLuint prog = glCreateProgram();
+		glAttachShader(prog, CS);
+		if(retrievable) {
+			glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+		glLinkProgram(prog);
+		glDeleteShader(CS);
+		return prog;
+	}
 	GLuint VS = glCreateShader(GL_VERTEX_SHADER);
 	GLuint FS = glCreateShader(GL_FRAGMENT_SHADER);
-	
-	// Read shader sources
-	const char *vshader = GLSL::textFileRead(vShaderName.c_str());
-	const char *fshader = GLSL::textFileRead(fShaderName.c_str());
 	glShaderSource(VS, 1, &vshader, NULL);
 	glShaderSource(FS, 1, &fshader, NULL);
-	
-	// Compile vertex shader
 	glCompileShader(VS);
-	glGetShaderiv(VS, GL_COMPILE_STATUS, &rc);
-	if(!rc) {
-		if(isVerbose()) {
-			GLSL::printShaderInfoLog(VS);
-			cout << "Error compiling vertex shader " << vShaderName << endl;
+	glCompileShader(FS);
+	
+	GLuint prog = glCreateProgram();
+	glAttachShader(prog, VS);
+	glAttachShader(prog, FS);
+	if(retrievable) {
+		glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(prog);
+	// The shaders are freed once the program is deleted
+	glDeleteShader(VS);
+	glDeleteShader(FS);
+	return prog;
+}
+
+bool Program::isBuildComplete(GLuint prog) const
+{
+#ifdef GL_KHR_parallel_shader_compile
+	if(GLEW_KHR_parallel_shader_compile) {
+		GLint done = GL_TRUE;
+		glGetProgramiv(prog, GL_COMPLETION_STATUS_KHR, &done);
+		return done == GL_TRUE;
+	}
+#endif
+	// Without the extension the status queries below simply block
+	return true;
+}
+
+bool Program::finishBuild(GLuint prog, bool log) const
+{
+	GLint rc;
+	glGetProgramiv(prog, GL_LINK_STATUS, &rc);
+	if(rc) {
+		return true;
+	}
+	if(log) {
+		bool compiled = true;
+		GLuint shaders[2];
+		GLsizei count = 0;
+		glGetAttachedShaders(prog, 2, &count, shaders);
+		for(GLsizei i = 0; i < count; ++i) {
+			glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &rc);
+			if(!rc) {
+				GLint type;
+				glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type);
+				GLSL::printShaderInfoLog(shaders[i]);
+				if(type == GL_COMPUTE_SHADER) {
+					cout << "Error compiling compute shader " << vShaderName << endl;
+				} else if(type == GL_VERTEX_SHADER) {
+					cout << "Error compiling vertex shader " << vShaderName << endl;
+				} else {
+					cout << "Error compiling fragment shader " << fShaderName << endl;
+				}
+				compiled = false;
+			}
 		}
-		return false;
+		if(compiled) {
+			GLSL::printProgramInfoLog(prog);
+			cout << "Error linking shaders " << vShaderName << " and " << fShaderName << endl;
+		}
+	}
+	glDeleteProgram(prog);
+	return false;
+}
+
+GLuint Program::loadBinary(const string &fileName) const
+{
+	FILE *fp = fopen(fileName.c_str(), "rb");
+	if(fp == NULL) {
+		return 0;
+	}
+	// File layout: binary format (GLenum), then the program binary
+	GLenum format = 0;
+	vector<char> binary;
+	if(fread(&format, sizeof(format), 1, fp) == 1) {
+		long start = ftell(fp);
+		fseek(fp, 0, SEEK_END);
+		long count = ftell(fp) - start;
+		fseek(fp, start, SEEK_SET);
+		if(count > 0) {
+			binary.resize(count);
+			binary.resize(fread(&binary[0], 1, count, fp));
+		}
+	}
+	fclose(fp);
+	if(binary.empty()) {
+		return 0;
 	}
 	
-	// Compile fragment shader
-	glCompileShader(FS);
-	glGetShaderiv(FS, GL_COMPILE_STATUS, &rc);
-	if(!rc) {
+	// Errors from earlier calls are reported first, so that only the one a
+	// rejected binary raises is discarded below
+	GLSL::clearErrors(GET_FILE_LINE);
+	GLuint prog = glCreateProgram();
+	GLSL::beginExpectedErrors();
+	glProgramBinary(prog, format, &binary[0], (GLsizei)binary.size());
+	GLenum err = glGetError(); // GL_INVALID_ENUM for formats the driver dropped
+	GLSL::endExpectedErrors();
+	GLint rc;
+	glGetProgramiv(prog, GL_LINK_STATUS, &rc);
+	if(!rc || err != GL_NO_ERROR) {
+		// Stale or rejected binary (e.g. driver update): fall back to source
 		if(isVerbose()) {
-			GLSL::printShaderInfoLog(FS);
-			cout << "Error compiling fragment shader " << fShaderName << endl;
+			cout << "Ignoring program binary " << fileName << endl;
 		}
-		return false;
+		glDeleteProgram(prog);
+		return 0;
 	}
-	
-	// Create the program and link
-	pid = glCreateProgram();
-	glAttachShader(pid, VS);
-	glAttachShader(pid, FS);
-	glLinkProgram(pid);
-	glGetProgramiv(pid, GL_LINK_STATUS, &rc);
-	if(!rc) {
+	return prog;
+}
+
+void Program::saveBinary(const string &fileName) const
+{
+	GLint length = 0;
+	glGetProgramiv(pid, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0) {
+		return;
+	}
+	vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(pid, length, NULL, &format, &binary[0]);
+	FILE *fp = fopen(fileName.c_str(), "wb");
+	if(fp == NULL) {
 		if(isVerbose()) {
-			GLSL::printProgramInfoLog(pid);
-			cout << "Error linking shaders " << vShaderName << " and " << fShaderName << endl;
+			cout << "Cannot write program binary " << fileName << endl;
 		}
-		return false;
+		return;
 	}
-	
-	GLSL::checkError(GET_FILE_LINE);
-	return true;
+	fwrite(&format, sizeof(format), 1, fp);
+	fwrite(&binary[0], 1, binary.size(), fp);
+	fclose(fp);
 }
 
 void Program::bind()
 {
-	glUseProgram(pid);
+	GLState::useProgram(pid);
 }
 
 void Program::unbind()
 {
-	glUseProgram(0);
+	// Programs stay bound until another one is bound, so that unbinding and
+	// rebinding the same program costs nothing (see GLState).
+}
+
+map<string,int> &Program::attributeHandles()
+{
+	static map<string,int> handles;
+	return handles;
+}
+
+map<string,int> &Program::uniformHandles()
+{
+	static map<string,int> handles;
+	return handles;
+}
+
+int Program::findHandle(map<string,int> &handles, const string &name)
+{
+	map<string,int>::const_iterator handle = handles.find(name);
+	if(handle != handles.end()) {
+		return handle->second;
+	}
+	int h = (int)handles.size();
+	handles[name] = h;
+	return h;
+}
+
+int Program::attributeHandle(const string &name)
+{
+	return findHandle(attributeHandles(), name);
+}
+
+int Program::uniformHandle(const string &name)
+{
+	return findHandle(uniformHandles(), name);
 }
 
-void Program::addAttribute(const string &name)
+int Program::addAttribute(const string &name)
 {
-	attributes[name] = glGetAttribLocation(pid, name.c_str());
+	int h = attributeHandle(name);
+	if(h >= (int)attributes.size()) {
+		attributes.resize(h + 1, -1);
+	}
+	if(h >= (int)attributeNames.size()) {
+		attributeNames.resize(h + 1);
+	}
+	attributes[h] = glGetAttribLocation(pid, name.c_str());
+	attributeNames[h] = name;
+	return h;
 }
 
-void Program::addUniform(const string &name)
+int Program::addUniform(const string &name)
 {
-	uniforms[name] = glGetUniformLocation(pid, name.c_str());
+	int h = uniformHandle(name);
+	if(h >= (int)uniforms.size()) {
+		uniforms.resize(h + 1, -1);
+	}
+	if(h >= (int)uniformNames.size()) {
+		uniformNames.resize(h + 1);
+	}
+	uniforms[h] = glGetUniformLocation(pid, name.c_str());
+	uniformNames[h] = name;
+	return h;
+}
+
+void Program::addUniformBlock(const string &name, GLuint binding)
+{
+	uniformBlocks.push_back(make_pair(name, binding));
+	setUniformBlockBinding(name, binding);
+}
+
+void Program::setUniformBlockBinding(const string &name, GLuint binding)
+{
+	GLuint index = glGetUniformBlockIndex(pid, name.c_str());
+	if(index == GL_INVALID_INDEX) {
+		if(isVerbose()) {
+			cout << name << " is not a uniform block" << endl;
+		}
+		return;
+	}
+	glUniformBlockBinding(pid, index, binding);
 }
 
 GLint Program::getAttribute(const string &name) const
 {
-	map<string,GLint>::const_iterator attribute = attributes.find(name.c_str());
-	if(attribute == attributes.end()) {
+	const map<string,int> &handles = attributeHandles();
+	map<string,int>::const_iterator handle = handles.find(name);
+	if(handle == handles.end() || handle->second >= (int)attributes.size()) {
 		if(isVerbose()) {
 			cout << name << " is not an attribute variable" << endl;
 		}
 		return -1;
 	}
-	return attribute->second;
+	return attributes[handle->second];
 }
 
 GLint Program::getUniform(const string &name) const
 {
-	map<string,GLint>::const_iterator uniform = uniforms.find(name.c_str());
-	if(uniform == uniforms.end()) {
+	const map<string,int> &handles = uniformHandles();
+	map<string,int>::const_iterator handle = handles.find(name);
+	if(handle == handles.end() || handle->second >= (int)uniforms.size()) {
 		if(isVerbose()) {
 			cout << name << " is not a uniform variable" << endl;
 		}
 		return -1;
 	}
-	return uniform->second;
+	return uniforms[handle->second];
 }
@@ -4,12 +4,16 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #define GLEW_STATIC
 #include <GL/glew.h>
 
 /**
- * An OpenGL Program (vertex and fragment shaders)
+ * An OpenGL Program (vertex and fragment shaders, or one compute shader)
+ * Attribute and uniform names are resolved once into small integer handles
+ * that are shared by all programs (e.g. "aPos" has the same handle in every
+ * program), so draw code can look up locations without any string work.
  */
 class Program
 {
@@ -21,23 +25,69 @@ public:
 	bool isVerbose() const { return verbose; }
 	
 	void setShaderNames(const std::string &v, const std::string &f);
+	// Makes this a compute program; its shader is reported as the vertex shader
+	void setComputeShaderName(const std::string &c);
+	bool isCompute() const { return compute; }
 	virtual bool init();
 	virtual void bind();
 	virtual void unbind();
+	
+	// Hot reload: beginReload() starts rebuilding from the shader files
+	// without waiting for the driver, and pollReload() (once per frame) swaps
+	// the new program in once it is ready. On failure the old program is kept.
+	// pollReload() returns true when a pending reload has finished.
+	void beginReload();
+	bool pollReload();
+	const std::string &getVertexShaderName() const { return vShaderName; }
+	const std::string &getFragmentShaderName() const { return fShaderName; }
+	GLuint getPID() const { return pid; }
 
-	void addAttribute(const std::string &name);
-	void addUniform(const std::string &name);
+	int addAttribute(const std::string &name);
+	int addUniform(const std::string &name);
+	void addUniformBlock(const std::string &name, GLuint binding);
 	GLint getAttribute(const std::string &name) const;
 	GLint getUniform(const std::string &name) const;
 	
+	// Handle based lookups for hot paths (-1 if the program does not have it)
+	GLint getAttribute(int handle) const { return handle < (int)attributes.size() ? attributes[handle] : -1; }
+	GLint getUniform(int handle) const { return handle < (int)uniforms.size() ? uniforms[handle] : -1; }
+	
+	// Process-wide handle for a name, allocated on first use
+	static int attributeHandle(const std::string &name);
+	static int uniformHandle(const std::string &name);
+	
+	// Directory (with trailing slash) for cached program binaries; empty
+	// disables the cache
+	static void setBinaryCacheDir(const std::string &dir);
+	
 protected:
 	std::string vShaderName;
 	std::string fShaderName;
 	
 private:
+	GLuint beginBuild(const char *vshader, const char *fshader, bool retrievable) const;
+	bool isBuildComplete(GLuint prog) const;
+	bool finishBuild(GLuint prog, bool log) const;
+	void setUniformBlockBinding(const std::string &name, GLuint binding);
+	std::string binaryCacheName(const char *vshader, const char *fshader) const;
+	GLuint loadBinary(const std::string &fileName) const;
+	void saveBinary(const std::string &fileName) const;
+	static std::string &binaryCacheDir();
+	
+	static int findHandle(std::map<std::string,int> &handles, const std::string &name);
+	static std::map<std::string,int> &attributeHandles();
+	static std::map<std::string,int> &uniformHandles();
+	
 	GLuint pid;
-	std::map<std::string,GLint> attributes;
-	std::map<std::string,GLint> uniforms;
+	GLuint pendingPid; // program being rebuilt by beginReload()
+	std::string pendingCacheName;
+	std::vector<GLint> attributes; // indexed by attribute handle
+	std::vector<GLint> uniforms;   // indexed by uniform handle
+	// Names added to this program, kept so a reload can re-resolve them
+	std::vector<std::string> attributeNames;
+	std::vector<std::string> uniformNames;
+	std::vector< std::pair<std::string,GLuint> > uniformBlocks;
+	bool compute;
 	bool verbose;
 };
 
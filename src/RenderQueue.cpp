@@ -0,0 +1,212 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GLState.h"
+#include "Program.h"
+#include "Shape.h"
+#include "UniformBuffer.h"
+
+using namespace std;
+
+static const int A_M = Program::attributeHandle("aM");
+
+// Packets per indirect call, so one call's data always fits in a segment
+static const size_t MAX_BATCH = 1024;
+
+CommandList::CommandList() :
+	state(0),
+	order(0)
+{
+	
+}
+
+void CommandList::submit(unsigned layer, shared_ptr<Program> prog, const Shape *shape, const glm::mat4 &M)
+{
+	Packet packet;
+	packet.key = 0;
+	packet.key |= (uint64_t)(layer & 0xFF) << 56;
+	packet.key |= (uint64_t)(state & 0xFF) << 48;
+	packet.key |= (uint64_t)(prog->getPID() & 0xFFFF) << 32;
+	packet.key |= (uint64_t)(shape->getID() & 0xFFFF) << 16;
+	packet.key |= (uint64_t)order;
+	// RenderQueue::flush() indexes packets with 24 bits
+	assert(packets.size() < (1u << 24));
+	packet.prog = prog;
+	packet.shape = shape;
+	packet.M = M;
+	packet.state = state;
+	packets.push_back(packet);
+}
+
+RenderQueue::RenderQueue(shared_ptr<UniformBuffer> objectUBO, int lists) :
+	objectUBO(objectUBO),
+	lists(max(lists, 1))
+{
+	
+}
+
+RenderQueue::~RenderQueue()
+{
+	
+}
+
+void RenderQueue::setState(unsigned state)
+{
+	for(size_t i = 0; i < lists.size(); ++i) {
+		lists[i].setState(state);
+	}
+}
+
+void RenderQueue::submit(unsigned layer, shared_ptr<Program> prog, const Shape *shape, const glm::mat4 &M)
+{
+	lists[0].submit(layer, prog, shape, M);
+}
+
+void RenderQueue::setIndirect(shared_ptr<MeshArena> arena, shared_ptr<Program> prog, shared_ptr<Program> progIndirect)
+{
+	this->arena = arena;
+	progDirect = prog;
+	this->progIndirect = progIndirect;
+	indirectStream.init(MAX_BATCH*(sizeof(glm::mat4) + sizeof(MeshArena::DrawCommand)) + 256);
+}
+
+void RenderQueue::flush()
+{
+	// Merge the lists. Equal keys keep their order within a list; across
+	// lists they only tie when the recording code gave them the same order.
+	keys.clear();
+	for(size_t l = 0; l < lists.size(); ++l) {
+		const vector<CommandList::Packet> &packets = lists[l].packets;
+		for(size_t i = 0; i < packets.size(); ++i) {
+			keys.push_back(make_pair(packets[i].key, (unsigned)(l << 24 | i)));
+		}
+	}
+	sort(keys.begin(), keys.end());
+	
+	stats = Stats();
+	if(arena) {
+		indirectStream.beginFrame();
+	}
+	const Program *prog = NULL;
+	unsigned mesh = 0;
+	unsigned currState = ~0u;
+	for(size_t i = 0; i < keys.size();) {
+		const CommandList::Packet &packet = getPacket(i);
+		if(packet.state != currState) {
+			if(packet.state & RenderQueue::CULL) {
+				GLState::enable(GL_CULL_FACE);
+			} else {
+				GLState::disable(GL_CULL_FACE);
+			}
+			GLState::polygonMode(packet.state & RenderQueue::WIREFRAME ? GL_LINE : GL_FILL);
+			currState = packet.state;
+			++stats.stateSwitches;
+		}
+		// The arena path needs aM (a reloaded shader may have dropped it)
+		if(arena && packet.prog == progDirect && progIndirect->getAttribute(A_M) != -1 &&
+		   arena->find(packet.shape) != -1) {
+			if(prog != progIndirect.get()) {
+				progIndirect->bind();
+				prog = progIndirect.get();
+				++stats.programSwitches;
+			}
+			mesh = 0; // the arena's buffers are bound now
+			i = flushIndirect(i);
+			continue;
+		}
+		if(packet.prog.get() != prog) {
+			packet.prog->bind();
+			prog = packet.prog.get();
+			mesh = 0; // attribute locations may differ
+			++stats.programSwitches;
+		}
+		// Copies of a Shape share their buffers, so compare the mesh and not the pointer
+		if(packet.shape->getID() != mesh) {
+			packet.shape->bind(packet.prog);
+			mesh = packet.shape->getID();
+			++stats.meshSwitches;
+		}
+		objectUBO->push(glm::value_ptr(packet.M), sizeof(glm::mat4));
+		packet.shape->drawArrays();
+		++stats.draws;
+		++i;
+	}
+	for(size_t l = 0; l < lists.size(); ++l) {
+		lists[l].clear();
+	}
+}
+
+size_t RenderQueue::flushIndirect(size_t begin)
+{
+	// Gather the run; the keys keep packets of one mesh next to each other
+	const CommandList::Packet &first = getPacket(begin);
+	commands.clear();
+	matrices.clear();
+	int lastMesh = -1;
+	size_t end = begin;
+	for(; end < keys.size() && end - begin < MAX_BATCH; ++end) {
+		const CommandList::Packet &packet = getPacket(end);
+		int m = arena->find(packet.shape);
+		if(packet.state != first.state || packet.prog != first.prog || m == -1) {
+			break;
+		}
+		if(m == lastMesh) {
+			++commands.back().instanceCount;
+		} else {
+			const MeshArena::Mesh &mesh = arena->getMesh(m);
+			MeshArena::DrawCommand command;
+			command.count = mesh.count;
+			command.instanceCount = 1;
+			command.firstIndex = mesh.firstIndex;
+			command.baseVertex = mesh.baseVertex;
+			command.baseInstance = (GLuint)matrices.size();
+			commands.push_back(command);
+			lastMesh = m;
+			++stats.meshSwitches;
+		}
+		matrices.push_back(packet.M);
+	}
+	
+	// Both writes must land in one segment: moving to the next segment
+	// fences the old one before the draw that reads the matrices is issued
+	GLsizeiptr sizeM = matrices.size()*sizeof(glm::mat4);
+	GLsizeiptr sizeCommands = commands.size()*sizeof(MeshArena::DrawCommand);
+	indirectStream.reserve(sizeM + sizeCommands + 2*16);
+	GLintptr offsetM = indirectStream.write(&matrices[0], sizeM);
+	GLintptr offsetCommands = indirectStream.write(&commands[0], sizeCommands);
+	
+	// aM takes four attribute slots, one per column (flush() only comes here
+	// when the program has it)
+	int h_m = progIndirect->getAttribute(A_M);
+	arena->bind(progIndirect.get(), h_m != -1 ? 0xFu << h_m : 0u);
+	GLState::bindArrayBuffer(indirectStream.getID());
+	for(int c = 0; c < 4; ++c) {
+		glVertexAttribPointer(h_m + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+		                      (const void *)(offsetM + c*sizeof(glm::vec4)));
+		GLState::vertexAttribDivisor(h_m + c, 1);
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectStream.getID());
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void *)offsetCommands, (GLsizei)commands.size(), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	
+	// Other programs may use these attribute indices for per-vertex data
+	for(int c = 0; c < 4; ++c) {
+		GLState::vertexAttribDivisor(h_m + c, 0);
+	}
+	stats.draws += (unsigned)(end - begin);
+	++stats.indirectCalls;
+	return end;
+}
+
+void RenderQueue::printStats() const
+{
+	printf("Render queue: %u draws (%u indirect calls), %u program, %u state and %u mesh switches\n",
+	       stats.draws, stats.indirectCalls, stats.programSwitches, stats.stateSwitches, stats.meshSwitches);
+	const StreamBuffer &stream = objectUBO->getStream();
+	printf("Object buffer: %s, %lu stalls\n",
+	       stream.isPersistent() ? "persistent mapping" : "glBufferSubData", stream.getStalls());
+}
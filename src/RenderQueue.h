@@ -0,0 +1,138 @@
+#pragma  once
+#ifndef __RenderQueue__
+#define __RenderQueue__
+
+#include <cassert>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "MeshArena.h"
+#include "StreamBuffer.h"
+
+class Program;
+class Shape;
+class UniformBuffer;
+
+/**
+ * Draw packets recorded by one thread. Recording makes no GL calls, so
+ * worker threads can each fill their own list while the GL thread only
+ * replays them in RenderQueue::flush().
+ */
+class CommandList
+{
+public:
+	CommandList();
+	
+	// State used for the packets submitted after this call
+	void setState(unsigned state) { this->state = state; }
+	// Position in the frame's submission order of the packets submitted
+	// after this call, the same whichever list records them (e.g. 1 + the
+	// keyframe index); 0 after clear()
+	void setOrder(unsigned order) { assert(order <= 0xFFFF); this->order = order; }
+	void submit(unsigned layer, std::shared_ptr<Program> prog, const Shape *shape, const glm::mat4 &M);
+	size_t size() const { return packets.size(); }
+	void clear() { packets.clear(); order = 0; }
+	
+private:
+	friend class RenderQueue;
+	friend class SoftRenderer;
+	
+	struct Packet
+	{
+		uint64_t key;
+		std::shared_ptr<Program> prog;
+		const Shape *shape;
+		glm::mat4 M;
+		unsigned state;
+	};
+	
+	std::vector<Packet> packets;
+	unsigned state;
+	unsigned order;
+};
+
+/**
+ * Collects draw packets from all passes and submits them sorted by a 64-bit
+ * key, so draws that share a program, render state and mesh end up next to
+ * each other and the switches between them are only made once.
+ *
+ * Key layout (most significant first):
+ *   8 bits layer | 8 bits state | 16 bits program | 16 bits mesh | 16 bits order
+ * The layer orders passes that must not be interleaved. The order bits come
+ * from CommandList::setOrder(), so equal draws sort the same way however the
+ * recording was split between threads; packets with equal keys keep their
+ * order within a list.
+ *
+ * There is one CommandList per thread that records draws; submit() records
+ * into list 0, which belongs to the GL thread.
+ *
+ * With setIndirect(), runs of packets that use a given program and meshes
+ * in a MeshArena are replayed as one glMultiDrawElementsIndirect with
+ * another program that reads M per draw. Packets of the same mesh become
+ * instances of one command.
+ */
+class RenderQueue
+{
+public:
+	// Render state bits
+	enum {
+		CULL = 1,
+		WIREFRAME = 2
+	};
+	
+	struct Stats
+	{
+		Stats() : draws(0), indirectCalls(0), programSwitches(0), stateSwitches(0), meshSwitches(0) {}
+		unsigned draws;
+		unsigned indirectCalls; // glMultiDrawElementsIndirect calls (part of draws)
+		unsigned programSwitches;
+		unsigned stateSwitches;
+		unsigned meshSwitches;
+	};
+	
+	RenderQueue(std::shared_ptr<UniformBuffer> objectUBO, int lists = 1);
+	virtual ~RenderQueue();
+	
+	int getListCount() const { return (int)lists.size(); }
+	CommandList &getList(int i) { return lists[i]; }
+	// State used by all lists for the packets submitted after this call
+	void setState(unsigned state);
+	void submit(unsigned layer, std::shared_ptr<Program> prog, const Shape *shape, const glm::mat4 &M);
+	// Draws the arena's meshes recorded with prog using progIndirect, which
+	// takes M from the per-instance attribute aM. Must be called on the GL
+	// thread.
+	void setIndirect(std::shared_ptr<MeshArena> arena, std::shared_ptr<Program> prog, std::shared_ptr<Program> progIndirect);
+	// Sorts and draws everything recorded since the last flush. Must be
+	// called on the GL thread once all recording threads are done.
+	void flush();
+	// Stats of the last flush
+	const Stats &getStats() const { return stats; }
+	void printStats() const;
+	
+private:
+	const CommandList::Packet &getPacket(size_t i) const
+	{
+		return lists[keys[i].second >> 24].packets[keys[i].second & 0xFFFFFF];
+	}
+	// Draws the packets from begin that can go in one indirect call; returns
+	// the first packet after them
+	size_t flushIndirect(size_t begin);
+	
+	std::shared_ptr<UniformBuffer> objectUBO;
+	std::vector<CommandList> lists;
+	std::vector< std::pair<uint64_t, unsigned> > keys; // (key, list << 24 | packet index)
+	Stats stats;
+	
+	std::shared_ptr<MeshArena> arena;
+	std::shared_ptr<Program> progDirect;   // replaced by progIndirect for the arena's meshes
+	std::shared_ptr<Program> progIndirect;
+	std::vector<MeshArena::DrawCommand> commands;
+	std::vector<glm::mat4> matrices;       // one per packet, indexed by baseInstance
+	StreamBuffer indirectStream;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "ShaderWatcher.h"
+
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include "Program.h"
+
+using namespace std;
+
+ShaderWatcher::ShaderWatcher() :
+	fd(-1),
+	wd(-1)
+{
+	
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+#ifdef __linux__
+	if(fd >= 0) {
+		close(fd);
+	}
+#endif
+}
+
+bool ShaderWatcher::init(const string &dir)
+{
+	this->dir = dir;
+#ifdef __linux__
+	// Non-blocking, so update() only drains events that are already queued
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(fd < 0) {
+		cerr << "inotify_init1 failed" << endl;
+		return false;
+	}
+	// Editors either rewrite the file in place or rename a temporary over it
+	wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if(wd < 0) {
+		cerr << "Cannot watch " << dir << endl;
+		close(fd);
+		fd = -1;
+		return false;
+	}
+	// Let the driver compile reloaded shaders on its own threads
+#ifdef GL_KHR_parallel_shader_compile
+	if(GLEW_KHR_parallel_shader_compile) {
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	}
+#endif
+	return true;
+#else
+	cerr << "Shader hot-reload is only supported on Linux" << endl;
+	return false;
+#endif
+}
+
+void ShaderWatcher::addProgram(shared_ptr<Program> prog)
+{
+	programs.push_back(prog);
+}
+
+void ShaderWatcher::update()
+{
+#ifdef __linux__
+	if(fd >= 0) {
+		// Collect the changed file names first, so a burst of events for the
+		// same file starts only one rebuild per program.
+		vector<bool> changed(programs.size(), false);
+		char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		for(;;) {
+			ssize_t len = read(fd, buf, sizeof(buf));
+			if(len <= 0) {
+				break;
+			}
+			for(char *ptr = buf; ptr < buf + len; ) {
+				const struct inotify_event *event = (const struct inotify_event *)ptr;
+				if(event->len > 0) {
+					string name = dir + event->name;
+					for(size_t i = 0; i < programs.size(); ++i) {
+						if(programs[i]->getVertexShaderName() == name || programs[i]->getFragmentShaderName() == name) {
+							changed[i] = true;
+						}
+					}
+				}
+				ptr += sizeof(struct inotify_event) + event->len;
+			}
+		}
+		for(size_t i = 0; i < programs.size(); ++i) {
+			if(changed[i]) {
+				programs[i]->beginReload();
+			}
+		}
+	}
+#endif
+	// Swap in any rebuilds that finished since the last frame
+	for(size_t i = 0; i < programs.size(); ++i) {
+		programs[i]->pollReload();
+	}
+}
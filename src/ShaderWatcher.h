@@ -0,0 +1,34 @@
+#pragma  once
+#ifndef __ShaderWatcher__
+#define __ShaderWatcher__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class Program;
+
+/**
+ * Watches the resource directory for shader edits (inotify, Linux only) and
+ * hot-reloads the programs that use the changed files. Call update() once per
+ * frame, outside of any draw, so programs are only swapped between frames.
+ */
+class ShaderWatcher
+{
+public:
+	ShaderWatcher();
+	virtual ~ShaderWatcher();
+	
+	// Returns false if file watching is not available
+	bool init(const std::string &dir);
+	void addProgram(std::shared_ptr<Program> prog);
+	void update();
+	
+private:
+	std::string dir;
+	std::vector< std::shared_ptr<Program> > programs;
+	int fd;
+	int wd;
+};
+
+#endif
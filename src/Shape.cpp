@@ -3,8 +3,11 @@
 
 #include <math.h>
 #include <cmath>
+#include "Bvh.h"
 #include "GLSL.h"
 #include "Program.h"
+#include "Trace.h"
+#include "GLState.h"
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -14,6 +17,11 @@
 
 using namespace std;
 
+// Attribute handles, resolved once instead of on every draw
+static const int A_POS = Program::attributeHandle("aPos");
+static const int A_NOR = Program::attributeHandle("aNor");
+static const int A_TEX = Program::attributeHandle("aTex");
+
 float min(float x, float y) {
 	if (x < y)
 		return x;
@@ -29,7 +37,8 @@ float max(float x, float y) {
 Shape::Shape() :
 	posBufID(0),
 	norBufID(0),
-	texBufID(0)
+	texBufID(0),
+	radius(0.0f)
 {
 }
 
@@ -39,6 +48,7 @@ Shape::~Shape()
 
 void Shape::loadMesh(const string &meshName)
 {
+	TraceScope trace("loadMesh", meshName.c_str());
 	// Load geometry
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
@@ -112,68 +122,161 @@ void Shape::fitToUnitBox()
 
 void Shape::init()
 {
+	// Bounding sphere around the center of the bounding box
+	if(!posBuf.empty()) {
+		glm::vec3 vmin(posBuf[0], posBuf[1], posBuf[2]);
+		glm::vec3 vmax = vmin;
+		for(int i = 0; i < (int)posBuf.size(); i += 3) {
+			glm::vec3 v(posBuf[i], posBuf[i+1], posBuf[i+2]);
+			vmin = glm::min(vmin, v);
+			vmax = glm::max(vmax, v);
+		}
+		center = 0.5f*(vmin + vmax);
+		radius = 0.0f;
+		for(int i = 0; i < (int)posBuf.size(); i += 3) {
+			radius = max(radius, glm::length(glm::vec3(posBuf[i], posBuf[i+1], posBuf[i+2]) - center));
+		}
+	}
+	
 	// Send the position array to the GPU
 	glGenBuffers(1, &posBufID);
-	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
+	GLState::bindArrayBuffer(posBufID);
 	glBufferData(GL_ARRAY_BUFFER, posBuf.size()*sizeof(float), &posBuf[0], GL_STATIC_DRAW);
 	
 	// Send the normal array to the GPU
 	if(!norBuf.empty()) {
 		glGenBuffers(1, &norBufID);
-		glBindBuffer(GL_ARRAY_BUFFER, norBufID);
+		GLState::bindArrayBuffer(norBufID);
 		glBufferData(GL_ARRAY_BUFFER, norBuf.size()*sizeof(float), &norBuf[0], GL_STATIC_DRAW);
 	}
 	
 	// Send the texture array to the GPU
 	if(!texBuf.empty()) {
 		glGenBuffers(1, &texBufID);
-		glBindBuffer(GL_ARRAY_BUFFER, texBufID);
+		GLState::bindArrayBuffer(texBufID);
 		glBufferData(GL_ARRAY_BUFFER, texBuf.size()*sizeof(float), &texBuf[0], GL_STATIC_DRAW);
 	}
 	
-	// Unbind the arrays
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	
 	GLSL::checkError(GET_FILE_LINE);
 }
 
+void Shape::buildBvh()
+{
+	int ntris = (int)posBuf.size()/9;
+	vector<glm::vec3> mins(ntris), maxs(ntris);
+	for(int i = 0; i < ntris; ++i) {
+		const float *v = &posBuf[9*i];
+		glm::vec3 a(v[0], v[1], v[2]), b(v[3], v[4], v[5]), c(v[6], v[7], v[8]);
+		mins[i] = glm::min(a, glm::min(b, c));
+		maxs[i] = glm::max(a, glm::max(b, c));
+	}
+	bvh = make_shared<Bvh>();
+	bvh->build(mins, maxs);
+}
+
+bool Shape::intersect(const glm::vec3 &origin, const glm::vec3 &dir, float &tmax) const
+{
+	if(!bvh) {
+		return false;
+	}
+	bool hit = false;
+	const float *pos = posBuf.empty() ? NULL : &posBuf[0];
+	bvh->intersect(origin, dir, tmax, [&](int tri, float &t) {
+		// Moller-Trumbore, both faces
+		const float *v = pos + 9*tri;
+		glm::vec3 a(v[0], v[1], v[2]);
+		glm::vec3 e1 = glm::vec3(v[3], v[4], v[5]) - a;
+		glm::vec3 e2 = glm::vec3(v[6], v[7], v[8]) - a;
+		glm::vec3 p = glm::cross(dir, e2);
+		float det = glm::dot(e1, p);
+		if(det == 0.0f) {
+			return;
+		}
+		float inv = 1.0f/det;
+		glm::vec3 s = origin - a;
+		float u = glm::dot(s, p)*inv;
+		if(u < 0.0f || u > 1.0f) {
+			return;
+		}
+		glm::vec3 q = glm::cross(s, e1);
+		float w = glm::dot(dir, q)*inv;
+		if(w < 0.0f || u + w > 1.0f) {
+			return;
+		}
+		float th = glm::dot(e2, q)*inv;
+		if(th >= 0.0f && th < t) {
+			t = th;
+			hit = true;
+		}
+	});
+	return hit;
+}
+
 void Shape::draw(const shared_ptr<Program> prog) const
 {
+	bind(prog);
+	drawArrays();
+}
+
+void Shape::bind(const shared_ptr<Program> prog, unsigned extraArrays) const
+{
+	int h_pos = prog->getAttribute(A_POS);
+	int h_nor = prog->getAttribute(A_NOR);
+	int h_tex = prog->getAttribute(A_TEX);
+	bool useNor = h_nor != -1 && norBufID != 0;
+	bool useTex = h_tex != -1 && texBufID != 0;
+	
+	// Attribute arrays stay enabled between draws; only changes reach GL
+	unsigned mask = extraArrays;
+	if(h_pos != -1) {
+		mask |= 1u << h_pos;
+	}
+	if(useNor) {
+		mask |= 1u << h_nor;
+	}
+	if(useTex) {
+		mask |= 1u << h_tex;
+	}
+	GLState::vertexAttribArrays(mask);
+	
 	// Bind position buffer
-	int h_pos = prog->getAttribute("aPos");
-	glEnableVertexAttribArray(h_pos);
-	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
-	glVertexAttribPointer(h_pos, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
+	if(h_pos != -1) {
+		GLState::bindArrayBuffer(posBufID);
+		glVertexAttribPointer(h_pos, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
+	}
 	
 	// Bind normal buffer
-	int h_nor = prog->getAttribute("aNor");
-	if(h_nor != -1 && norBufID != 0) {
-		glEnableVertexAttribArray(h_nor);
-		glBindBuffer(GL_ARRAY_BUFFER, norBufID);
+	if(useNor) {
+		GLState::bindArrayBuffer(norBufID);
 		glVertexAttribPointer(h_nor, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
 	}
 	
 	// Bind texcoords buffer
-	int h_tex = prog->getAttribute("aTex");
-	if(h_tex != -1 && texBufID != 0) {
-		glEnableVertexAttribArray(h_tex);
-		glBindBuffer(GL_ARRAY_BUFFER, texBufID);
+	if(useTex) {
+		GLState::bindArrayBuffer(texBufID);
 		glVertexAttribPointer(h_tex, 2, GL_FLOAT, GL_FALSE, 0, (const void *)0);
 	}
-	
-	// Draw
+}
+
+void Shape::drawArrays() const
+{
 	int count = posBuf.size()/3; // number of indices to be rendered
 	glDrawArrays(GL_TRIANGLES, 0, count);
 	
-	// Disable and unbind
-	if(h_tex != -1) {
-		glDisableVertexAttribArray(h_tex);
-	}
-	if(h_nor != -1) {
-		glDisableVertexAttribArray(h_nor);
-	}
-	glDisableVertexAttribArray(h_pos);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GLSL::checkError(GET_FILE_LINE);
+}
+
+void Shape::drawInstanced(int instances) const
+{
+	int count = posBuf.size()/3;
+	glDrawArraysInstancedARB(GL_TRIANGLES, 0, count, instances);
+	
+	GLSL::checkError(GET_FILE_LINE);
+}
+
+void Shape::drawIndirect(size_t offset) const
+{
+	glDrawArraysIndirect(GL_TRIANGLES, (const void *)offset);
 	
 	GLSL::checkError(GET_FILE_LINE);
 }
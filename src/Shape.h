@@ -6,6 +6,10 @@
 #include <vector>
 #include <memory>
 
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+class Bvh;
 class Program;
 
 /**
@@ -24,6 +28,31 @@ public:
 	void fitToUnitBox();
 	void init();
 	void draw(const std::shared_ptr<Program> prog) const;
+	// draw() split in two, so consecutive draws of the same mesh only bind once.
+	// extraArrays are attribute arrays to keep enabled (e.g. per-instance data).
+	void bind(const std::shared_ptr<Program> prog, unsigned extraArrays = 0) const;
+	void drawArrays() const;
+	void drawInstanced(int instances) const;
+	// Draws with the DrawArraysIndirectCommand at offset in the bound
+	// GL_DRAW_INDIRECT_BUFFER
+	void drawIndirect(size_t offset) const;
+	int getVertexCount() const { return (int)posBuf.size()/3; }
+	// Sphere around the vertices, valid after init()
+	const glm::vec3 &getCenter() const { return center; }
+	float getRadius() const { return radius; }
+	// Identifies the GPU mesh (copies of a Shape share it)
+	unsigned getID() const { return posBufID; }
+	// CPU copies of the vertex data (e.g. for MeshArena)
+	const std::vector<float> &getPosBuf() const { return posBuf; }
+	const std::vector<float> &getNorBuf() const { return norBuf; }
+	// Triangle BVH for intersect(), over the final vertices (after
+	// fitToUnitBox()); copies of the Shape share it. loadMesh() does not
+	// build it; Helicopter::load() does for the pickable parts.
+	void buildBvh();
+	// Closest hit of the ray origin + t*dir (in object space) with t < tmax,
+	// which is lowered to the hit. Needs buildBvh().
+	bool intersect(const glm::vec3 &origin, const glm::vec3 &dir, float &tmax) const;
+	std::shared_ptr<const Bvh> getBvh() const { return bvh; }
 	
 private:
 	std::vector<float> posBuf;
@@ -32,6 +61,9 @@ private:
 	unsigned posBufID;
 	unsigned norBufID;
 	unsigned texBufID;
+	glm::vec3 center;
+	float radius;
+	std::shared_ptr<Bvh> bvh;
 };
 
 #endif
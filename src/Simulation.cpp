@@ -0,0 +1,65 @@
+#include "Simulation.h"
+
+#include <chrono>
+
+#include "JobSystem.h"
+#include "Trace.h"
+
+using namespace std;
+
+// Falling further behind than this skips simulation time
+static const chrono::milliseconds MAX_LAG(250);
+
+Simulation::Simulation() :
+	quit(false)
+{
+	
+}
+
+Simulation::~Simulation()
+{
+	stop();
+}
+
+void Simulation::start(double rate, shared_ptr<JobSystem> jobs, const StepFunction &step)
+{
+	stop();
+	quit = false;
+	thread = std::thread(&Simulation::run, this, rate, jobs, step);
+}
+
+void Simulation::stop()
+{
+	if(thread.joinable()) {
+		quit = true;
+		thread.join();
+	}
+}
+
+void Simulation::run(double rate, shared_ptr<JobSystem> jobs, StepFunction step)
+{
+	jobs->attachThread();
+	const double dt = 1.0/rate;
+	const chrono::steady_clock::duration period =
+		chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(dt));
+	chrono::steady_clock::time_point next = chrono::steady_clock::now();
+	double t = 0.0;
+	for(long n = 0; !quit; ++n) {
+		{
+			TraceScope trace("simulate");
+			SimState &state = states.getBack();
+			step(t, dt, state);
+			state.t = t;
+			state.step = n;
+			states.publish();
+		}
+		t += dt;
+		next += period;
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if(now > next + MAX_LAG) {
+			next = now;
+		} else {
+			this_thread::sleep_until(next);
+		}
+	}
+}
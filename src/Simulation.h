@@ -0,0 +1,64 @@
+#pragma  once
+#ifndef __Simulation__
+#define __Simulation__
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include "TripleBuffer.h"
+
+class JobSystem;
+
+/**
+ * Everything the renderer needs from one simulation step
+ */
+struct SimState
+{
+	SimState() : t(0.0), step(0), q(1.0f, 0.0f, 0.0f, 0.0f) {}
+	double t;   // simulation time of this state
+	long step;  // index of the step that produced it
+	glm::vec3 p; // helicopter position
+	glm::quat q; // helicopter rotation
+	std::vector<glm::vec4> fleet; // packed fleet instances (see Fleet)
+};
+
+/**
+ * Runs the animation on its own thread at a fixed rate, independent of the
+ * display. Each step writes a SimState that the render thread picks up
+ * through a triple buffer, so neither thread ever waits for the other.
+ * If the simulation falls too far behind real time, it skips ahead rather
+ * than trying to catch up.
+ */
+class Simulation
+{
+public:
+	// step(t, dt, state) fills state for time t
+	typedef std::function<void(double, double, SimState &)> StepFunction;
+	
+	Simulation();
+	virtual ~Simulation();
+	
+	// jobs is attached to the simulation thread so steps can use it
+	void start(double rate, std::shared_ptr<JobSystem> jobs, const StepFunction &step);
+	void stop();
+	bool isRunning() const { return thread.joinable(); }
+	
+	// Render thread: the newest complete state
+	const SimState &latest() { return states.getFront(); }
+	
+private:
+	void run(double rate, std::shared_ptr<JobSystem> jobs, StepFunction step);
+	
+	TripleBuffer<SimState> states;
+	std::thread thread;
+	std::atomic<bool> quit;
+};
+
+#endif
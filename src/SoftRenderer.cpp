@@ -0,0 +1,444 @@
+#include "SoftRenderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+#include "JobSystem.h"
+#include "RenderQueue.h"
+#include "Shape.h"
+#include "Trace.h"
+
+// Four edge functions at once with SSE2 integer compares
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFTRENDERER_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Triangles per setup job
+static const int CHUNK = 1024;
+// Triangles are clipped to GUARD times the viewport around its center, which
+// bounds the subpixel coordinates (see rasterize())
+static const float GUARD = 4.0f;
+static const int SUBPIXELS = 1 << SoftRenderer::SUBPIXEL_BITS;
+
+SoftRenderer::SoftRenderer() :
+	width(0),
+	height(0),
+	tilesX(0),
+	tilesY(0),
+	cullFace(false)
+{
+
+}
+
+SoftRenderer::~SoftRenderer()
+{
+
+}
+
+void SoftRenderer::init(int width, int height, shared_ptr<JobSystem> jobs)
+{
+	this->width = width;
+	this->height = height;
+	this->jobs = jobs;
+	tilesX = (width + TILE - 1)/TILE;
+	tilesY = (height + TILE - 1)/TILE;
+	depth.resize(width*height);
+	pixels.resize(3*width*height);
+	int threads = jobs->getCount();
+	triangles.resize(threads);
+	bins.resize(threads);
+	for(int i = 0; i < threads; ++i) {
+		bins[i].resize(tilesX*tilesY);
+	}
+	scratch.resize(threads);
+}
+
+void SoftRenderer::setCamera(const glm::mat4 &P, const glm::mat4 &V)
+{
+	this->P = P;
+	this->V = V;
+}
+
+void SoftRenderer::clear(const glm::vec3 &color)
+{
+	clearColor = color;
+	unsigned char rgb[3];
+	for(int k = 0; k < 3; ++k) {
+		rgb[k] = (unsigned char)(min(max(color[k], 0.0f), 1.0f)*255.0f + 0.5f);
+	}
+	for(int i = 0; i < width*height; ++i) {
+		pixels[3*i] = rgb[0];
+		pixels[3*i + 1] = rgb[1];
+		pixels[3*i + 2] = rgb[2];
+	}
+	fill(depth.begin(), depth.end(), 1.0f);
+}
+
+void SoftRenderer::draw(const Shape *shape, const glm::mat4 &M)
+{
+	Draw d;
+	d.shape = shape;
+	d.MV = V*M;
+	d.PVM = P*d.MV;
+	d.cull = cullFace;
+	draws.push_back(d);
+}
+
+void SoftRenderer::draw(const CommandList &list)
+{
+	bool cull = cullFace;
+	for(size_t i = 0; i < list.packets.size(); ++i) {
+		const CommandList::Packet &packet = list.packets[i];
+		cullFace = (packet.state & RenderQueue::CULL) != 0;
+		draw(packet.shape, packet.M);
+	}
+	cullFace = cull;
+}
+
+void SoftRenderer::finish()
+{
+	TraceScope trace("SoftRenderer::finish");
+	for(size_t t = 0; t < triangles.size(); ++t) {
+		triangles[t].clear();
+		for(size_t i = 0; i < bins[t].size(); ++i) {
+			bins[t][i].clear();
+		}
+	}
+
+	// Setup: split the draws into chunks of triangles
+	vector< pair<int, int> > chunks; // (draw, first triangle)
+	for(size_t d = 0; d < draws.size(); ++d) {
+		int count = (int)draws[d].shape->getPosBuf().size()/9;
+		for(int t = 0; t < count; t += CHUNK) {
+			chunks.push_back(make_pair((int)d, t));
+		}
+	}
+	jobs->parallelFor((int)chunks.size(), 1, [this, &chunks](int thread, int begin, int end) {
+		for(int c = begin; c < end; ++c) {
+			int d = chunks[c].first;
+			int count = (int)draws[d].shape->getPosBuf().size()/9;
+			setup(thread, d, chunks[c].second, min(chunks[c].second + CHUNK, count));
+		}
+	});
+
+	// Rasterization: tiles share no pixels, so they need no locking
+	jobs->parallelFor(tilesX*tilesY, 1, [this](int thread, int begin, int end) {
+		for(int tile = begin; tile < end; ++tile) {
+			rasterizeTile(thread, tile);
+		}
+	});
+	draws.clear();
+}
+
+void SoftRenderer::setup(int thread, int drawIndex, int begin, int end)
+{
+	// Clip planes, inside where dot(plane, clip) >= 0: near, then the guard band
+	static const glm::vec4 planes[5] = {
+		glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),
+		glm::vec4(-1.0f, 0.0f, 0.0f, GUARD),
+		glm::vec4(1.0f, 0.0f, 0.0f, GUARD),
+		glm::vec4(0.0f, -1.0f, 0.0f, GUARD),
+		glm::vec4(0.0f, 1.0f, 0.0f, GUARD)
+	};
+	const Draw &d = draws[drawIndex];
+	const vector<float> &pos = d.shape->getPosBuf();
+	const vector<float> &nor = d.shape->getNorBuf();
+	for(int t = begin; t < end; ++t) {
+		// Vertex shader (normal_vert.glsl)
+		glm::vec4 clip[3];
+		glm::vec3 n[3];
+		unsigned outside = 0;
+		for(int k = 0; k < 3; ++k) {
+			int i = 9*t + 3*k;
+			clip[k] = d.PVM*glm::vec4(pos[i], pos[i+1], pos[i+2], 1.0f);
+			n[k] = nor.empty() ? glm::vec3(0.0f) : glm::vec3(d.MV*glm::vec4(nor[i], nor[i+1], nor[i+2], 0.0f));
+			for(int p = 0; p < 5; ++p) {
+				if(glm::dot(planes[p], clip[k]) < 0.0f) {
+					outside |= 1u << p;
+				}
+			}
+		}
+		uint64_t order = (uint64_t)drawIndex << 32 | (uint64_t)t << 3;
+		if(!outside) {
+			emit(thread, d, clip, n, order);
+			continue;
+		}
+
+		// Sutherland-Hodgman against the planes any vertex is outside of;
+		// each plane adds at most one vertex
+		glm::vec4 polyClip[2][8];
+		glm::vec3 polyNor[2][8];
+		int count = 3;
+		for(int k = 0; k < 3; ++k) {
+			polyClip[0][k] = clip[k];
+			polyNor[0][k] = n[k];
+		}
+		int src = 0;
+		for(int p = 0; p < 5 && count > 0; ++p) {
+			if(!(outside & 1u << p)) {
+				continue;
+			}
+			int dst = 1 - src;
+			int out = 0;
+			for(int k = 0; k < count; ++k) {
+				int k1 = (k + 1) % count;
+				float d0 = glm::dot(planes[p], polyClip[src][k]);
+				float d1 = glm::dot(planes[p], polyClip[src][k1]);
+				if(d0 >= 0.0f) {
+					polyClip[dst][out] = polyClip[src][k];
+					polyNor[dst][out] = polyNor[src][k];
+					++out;
+				}
+				if((d0 >= 0.0f) != (d1 >= 0.0f)) {
+					float s = d0/(d0 - d1);
+					polyClip[dst][out] = polyClip[src][k] + s*(polyClip[src][k1] - polyClip[src][k]);
+					polyNor[dst][out] = polyNor[src][k] + s*(polyNor[src][k1] - polyNor[src][k]);
+					++out;
+				}
+			}
+			count = out;
+			src = dst;
+		}
+		// Fan
+		for(int k = 1; k + 1 < count; ++k) {
+			glm::vec4 c[3] = { polyClip[src][0], polyClip[src][k], polyClip[src][k+1] };
+			glm::vec3 m[3] = { polyNor[src][0], polyNor[src][k], polyNor[src][k+1] };
+			emit(thread, d, c, m, order | (uint64_t)(k - 1));
+		}
+	}
+}
+
+// Coefficients of the plane through (x[i], y[i], a[i])
+static void setPlane(float &a, float &dx, float &dy, const double x[3], const double y[3], const double v[3], double area)
+{
+	a = (float)v[0];
+	dx = (float)(((v[1] - v[0])*(y[2] - y[0]) - (v[2] - v[0])*(y[1] - y[0]))/area);
+	dy = (float)(((v[2] - v[0])*(x[1] - x[0]) - (v[1] - v[0])*(x[2] - x[0]))/area);
+}
+
+void SoftRenderer::emit(int thread, const Draw &d, const glm::vec4 clip[3], const glm::vec3 nor[3], uint64_t order)
+{
+	// Viewport transform, snapped to the subpixel grid
+	Triangle tri;
+	double z[3];
+	glm::vec3 n[3];
+	int v[3] = { 0, 1, 2 };
+	for(int k = 0; k < 3; ++k) {
+		float w = 1.0f/clip[k].w;
+		tri.X[k] = (int32_t)floor((clip[k].x*w*0.5f + 0.5f)*width*SUBPIXELS + 0.5f);
+		tri.Y[k] = (int32_t)floor((clip[k].y*w*0.5f + 0.5f)*height*SUBPIXELS + 0.5f);
+		z[k] = clip[k].z*w*0.5f + 0.5f;
+		n[k] = nor[k]*w;
+	}
+
+	// Twice the signed area; counter-clockwise is front facing
+	int64_t area = (int64_t)(tri.X[1] - tri.X[0])*(tri.Y[2] - tri.Y[0]) - (int64_t)(tri.X[2] - tri.X[0])*(tri.Y[1] - tri.Y[0]);
+	if(area == 0 || (area < 0 && d.cull)) {
+		return;
+	}
+	if(area < 0) {
+		swap(tri.X[1], tri.X[2]);
+		swap(tri.Y[1], tri.Y[2]);
+		swap(v[1], v[2]);
+		area = -area;
+	}
+
+	// Pixels whose centers may be covered
+	int minXs = min(tri.X[0], min(tri.X[1], tri.X[2]));
+	int maxXs = max(tri.X[0], max(tri.X[1], tri.X[2]));
+	int minYs = min(tri.Y[0], min(tri.Y[1], tri.Y[2]));
+	int maxYs = max(tri.Y[0], max(tri.Y[1], tri.Y[2]));
+	tri.minX = max(0, (int)ceil((minXs - SUBPIXELS/2)/(double)SUBPIXELS));
+	tri.maxX = min(width - 1, (int)floor((maxXs - SUBPIXELS/2)/(double)SUBPIXELS));
+	tri.minY = max(0, (int)ceil((minYs - SUBPIXELS/2)/(double)SUBPIXELS));
+	tri.maxY = min(height - 1, (int)floor((maxYs - SUBPIXELS/2)/(double)SUBPIXELS));
+	if(tri.minX > tri.maxX || tri.minY > tri.maxY) {
+		return;
+	}
+
+	// Interpolation in window space: depth linearly, the normal over w
+	double x[3], y[3], a[3];
+	for(int k = 0; k < 3; ++k) {
+		x[k] = tri.X[k]/(double)SUBPIXELS;
+		y[k] = tri.Y[k]/(double)SUBPIXELS;
+	}
+	double areaPixels = area/((double)SUBPIXELS*SUBPIXELS);
+	tri.x0 = (float)x[0];
+	tri.y0 = (float)y[0];
+	for(int k = 0; k < 3; ++k) {
+		a[k] = z[v[k]];
+	}
+	setPlane(tri.z.a, tri.z.dx, tri.z.dy, x, y, a, areaPixels);
+	for(int c = 0; c < 3; ++c) {
+		for(int k = 0; k < 3; ++k) {
+			a[k] = n[v[k]][c];
+		}
+		setPlane(tri.nor[c].a, tri.nor[c].dx, tri.nor[c].dy, x, y, a, areaPixels);
+	}
+	tri.order = order;
+
+	vector<Triangle> &list = triangles[thread];
+	uint32_t index = (uint32_t)list.size();
+	list.push_back(tri);
+	for(int ty = tri.minY/TILE; ty <= tri.maxY/TILE; ++ty) {
+		for(int tx = tri.minX/TILE; tx <= tri.maxX/TILE; ++tx) {
+			bins[thread][ty*tilesX + tx].push_back(index);
+		}
+	}
+}
+
+void SoftRenderer::rasterizeTile(int thread, int tile)
+{
+	// Triangles binned by all setup threads, back in submission order
+	vector< pair<uint64_t, uint32_t> > &refs = scratch[thread];
+	refs.clear();
+	for(size_t t = 0; t < bins.size(); ++t) {
+		const vector<uint32_t> &bin = bins[t][tile];
+		for(size_t i = 0; i < bin.size(); ++i) {
+			refs.push_back(make_pair(triangles[t][bin[i]].order, (uint32_t)(t << 24 | bin[i])));
+		}
+	}
+	sort(refs.begin(), refs.end());
+
+	int x0 = (tile % tilesX)*TILE;
+	int y0 = (tile / tilesX)*TILE;
+	int x1 = min(x0 + TILE, width) - 1;
+	int y1 = min(y0 + TILE, height) - 1;
+	for(size_t i = 0; i < refs.size(); ++i) {
+		rasterize(triangles[refs[i].second >> 24][refs[i].second & 0xFFFFFF], x0, y0, x1, y1);
+	}
+}
+
+void SoftRenderer::rasterize(const Triangle &tri, int x0, int y0, int x1, int y1)
+{
+	x0 = max(x0, tri.minX);
+	y0 = max(y0, tri.minY);
+	x1 = min(x1, tri.maxX);
+	y1 = min(y1, tri.maxY);
+	if(x0 > x1 || y0 > y1) {
+		return;
+	}
+
+	// Edge functions E(p) = (b - a) x (p - a), positive inside, in units of
+	// subpixels squared. The guard band keeps a coordinate difference within
+	// 2^(SUBPIXEL_BITS + 15) for viewports up to 8192 pixels, so across one
+	// tile an edge that crosses it stays far from 32-bit overflow; the rest
+	// are trivially in or out.
+	int32_t e0[3], dx[3], dy[3], bias[3];
+	for(int i = 0; i < 3; ++i) {
+		int a = i;
+		int b = (i + 1) % 3;
+		int32_t ex = tri.X[b] - tri.X[a];
+		int32_t ey = tri.Y[b] - tri.Y[a];
+		int64_t px = (int64_t)x0*SUBPIXELS + SUBPIXELS/2 - tri.X[a];
+		int64_t py = (int64_t)y0*SUBPIXELS + SUBPIXELS/2 - tri.Y[a];
+		int64_t e = (int64_t)ex*py - (int64_t)ey*px;
+		int64_t stepX = -(int64_t)ey*SUBPIXELS;
+		int64_t stepY = (int64_t)ex*SUBPIXELS;
+		// Top-left rule: pixels exactly on an edge belong to the triangle if
+		// the edge is a top or a left edge
+		bias[i] = (ey < 0 || (ey == 0 && ex < 0)) ? 0 : 1;
+		int64_t emin = e + min<int64_t>(stepX*(x1 - x0), 0) + min<int64_t>(stepY*(y1 - y0), 0);
+		int64_t emax = e + max<int64_t>(stepX*(x1 - x0), 0) + max<int64_t>(stepY*(y1 - y0), 0);
+		if(emax < bias[i]) {
+			return;
+		}
+		if(emin >= bias[i]) {
+			e0[i] = 1;
+			dx[i] = dy[i] = 0;
+			bias[i] = 0;
+		} else {
+			e0[i] = (int32_t)e;
+			dx[i] = (int32_t)stepX;
+			dy[i] = (int32_t)stepY;
+		}
+	}
+
+#ifdef SOFTRENDERER_SSE2
+	__m128i laneStep[3], blockStep[3], threshold[3];
+	for(int i = 0; i < 3; ++i) {
+		laneStep[i] = _mm_set_epi32(3*dx[i], 2*dx[i], dx[i], 0);
+		blockStep[i] = _mm_set1_epi32(4*dx[i]);
+		threshold[i] = _mm_set1_epi32(bias[i] - 1);
+	}
+#endif
+	for(int y = y0; y <= y1; ++y) {
+		int32_t row[3];
+		for(int i = 0; i < 3; ++i) {
+			row[i] = e0[i] + dy[i]*(y - y0);
+		}
+#ifdef SOFTRENDERER_SSE2
+		__m128i e[3];
+		for(int i = 0; i < 3; ++i) {
+			e[i] = _mm_add_epi32(_mm_set1_epi32(row[i]), laneStep[i]);
+		}
+#endif
+		float fy = y + 0.5f - tri.y0;
+		for(int x = x0; x <= x1; x += 4) {
+			// Coverage of pixels x .. x + 3
+#ifdef SOFTRENDERER_SSE2
+			__m128i in = _mm_and_si128(_mm_cmpgt_epi32(e[0], threshold[0]),
+			             _mm_and_si128(_mm_cmpgt_epi32(e[1], threshold[1]), _mm_cmpgt_epi32(e[2], threshold[2])));
+			int mask = _mm_movemask_ps(_mm_castsi128_ps(in));
+			for(int i = 0; i < 3; ++i) {
+				e[i] = _mm_add_epi32(e[i], blockStep[i]);
+			}
+#else
+			int mask = 0;
+			for(int j = 0; j < 4; ++j) {
+				bool in = true;
+				for(int i = 0; i < 3; ++i) {
+					in = in && row[i] + dx[i]*(x - x0 + j) >= bias[i];
+				}
+				mask |= in ? 1 << j : 0;
+			}
+#endif
+			if(x1 - x < 3) {
+				mask &= (1 << (x1 - x + 1)) - 1;
+			}
+			for(int j = 0; mask; ++j, mask >>= 1) {
+				if(!(mask & 1)) {
+					continue;
+				}
+				// Depth test, then the fragment shader (normal_frag.glsl)
+				float fx = x + j + 0.5f - tri.x0;
+				float z = tri.z.a + tri.z.dx*fx + tri.z.dy*fy;
+				int index = y*width + x + j;
+				if(!(z < depth[index]) || z < 0.0f) {
+					continue;
+				}
+				depth[index] = z;
+				glm::vec3 n;
+				for(int c = 0; c < 3; ++c) {
+					n[c] = tri.nor[c].a + tri.nor[c].dx*fx + tri.nor[c].dy*fy;
+				}
+				float length = glm::length(n);
+				glm::vec3 color = length > 0.0f ? 0.5f*(n/length) + 0.5f : glm::vec3(0.5f);
+				for(int c = 0; c < 3; ++c) {
+					pixels[3*index + c] = (unsigned char)(min(max(color[c], 0.0f), 1.0f)*255.0f + 0.5f);
+				}
+			}
+		}
+	}
+}
+
+bool SoftRenderer::writePPM(const string &fileName) const
+{
+	FILE *fp = fopen(fileName.c_str(), "wb");
+	if(fp == NULL) {
+		cerr << "Cannot write " << fileName << endl;
+		return false;
+	}
+	fprintf(fp, "P6\n%d %d\n255\n", width, height);
+	// Rows go bottom to top, as in GL
+	for(int y = height - 1; y >= 0; --y) {
+		fwrite(&pixels[3*width*y], 1, 3*width, fp);
+	}
+	fclose(fp);
+	return true;
+}
@@ -0,0 +1,106 @@
+#pragma  once
+#ifndef __SoftRenderer__
+#define __SoftRenderer__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+class CommandList;
+class JobSystem;
+class Shape;
+
+/**
+ * Renders Shapes on the CPU, for machines without GL
+ * - Shading matches normal_vert.glsl/normal_frag.glsl (the view space
+ *   normal mapped to a color) with a less-than depth test. Rasterization
+ *   follows GL's rules (snapped vertices, pixel centers, top-left fill,
+ *   counter-clockwise front faces), so images match the GL path up to
+ *   rounding.
+ * - draw() only records. finish() runs two parallel passes on the job
+ *   system: triangle setup clips, culls and bins the triangles into
+ *   TILE x TILE pixel tiles, then every tile is rasterized on its own with
+ *   integer edge functions, four pixels at a time (SSE2 when available).
+ * - Pixels are RGB with rows bottom to top, as glReadPixels returns them.
+ */
+class SoftRenderer
+{
+public:
+	enum {
+		TILE = 32,
+		SUBPIXEL_BITS = 4 // keeps the edge functions of a tile in 32 bits
+	};
+
+	SoftRenderer();
+	virtual ~SoftRenderer();
+
+	void init(int width, int height, std::shared_ptr<JobSystem> jobs);
+	void setCamera(const glm::mat4 &P, const glm::mat4 &V);
+	// Back face culling for the draws that follow
+	void setCullFace(bool cull) { cullFace = cull; }
+	void clear(const glm::vec3 &color);
+	// The shape must stay alive until finish()
+	void draw(const Shape *shape, const glm::mat4 &M);
+	// Draws the packets of a list (in any order; the depth test sorts them out)
+	void draw(const CommandList &list);
+	void finish();
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	const std::vector<unsigned char> &getPixels() const { return pixels; }
+	bool writePPM(const std::string &fileName) const;
+
+private:
+	struct Draw
+	{
+		const Shape *shape;
+		glm::mat4 PVM;
+		glm::mat4 MV;
+		bool cull;
+	};
+
+	// Plane equation of a value over the window: a + dx*(x - x0) + dy*(y - y0)
+	struct Plane
+	{
+		float a, dx, dy;
+	};
+
+	struct Triangle
+	{
+		int32_t X[3], Y[3];         // window coordinates in subpixels
+		int minX, minY, maxX, maxY; // covered pixels
+		float x0, y0;               // first vertex, in pixels
+		Plane z;
+		Plane nor[3];               // view space normal / w (normalized later,
+		                            // so the 1/w it is scaled by drops out)
+		uint64_t order;             // submission order, breaks depth ties like GL
+	};
+
+	void setup(int thread, int draw, int begin, int end);
+	void emit(int thread, const Draw &draw, const glm::vec4 clip[3], const glm::vec3 nor[3], uint64_t order);
+	void rasterizeTile(int thread, int tile);
+	void rasterize(const Triangle &tri, int x0, int y0, int x1, int y1);
+
+	int width;
+	int height;
+	int tilesX;
+	int tilesY;
+	std::shared_ptr<JobSystem> jobs;
+	glm::mat4 P;
+	glm::mat4 V;
+	bool cullFace;
+	glm::vec3 clearColor;
+
+	std::vector<Draw> draws;
+	std::vector< std::vector<Triangle> > triangles;            // per thread
+	std::vector< std::vector< std::vector<uint32_t> > > bins;  // per thread and tile
+	std::vector< std::vector< std::pair<uint64_t, uint32_t> > > scratch; // per thread
+	std::vector<float> depth;
+	std::vector<unsigned char> pixels;
+};
+
+#endif
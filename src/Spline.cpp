@@ -0,0 +1,153 @@
+#include "Spline.h"
+
+#include <cmath>
+
+using namespace std;
+
+Spline::Spline() :
+	smax(0.0f)
+{
+	Bcr[0] = glm::vec4(0.0f, 2.0f, 0.0f, 0.0f);
+	Bcr[1] = glm::vec4(-1.0f, 0.0f, 1.0f, 0.0f);
+	Bcr[2] = glm::vec4(2.0f, -5.0f, 4.0f, -1.0f);
+	Bcr[3] = glm::vec4(-1.0f, 3.0f, -3.0f, 1.0f);
+	Bcr *= 0.5;
+}
+
+Spline::~Spline()
+{
+}
+
+void Spline::addControlPoint(const glm::vec3 &p)
+{
+	cps.push_back(p);
+}
+
+void Spline::buildTable()
+{
+	float max_u = cps.size() - 3; // this is because ther eare 8 points and so 8 - 3 = 5
+
+	usTable.clear();
+	if (cps.size() >= 4) {
+		glm::mat4 G;
+		float step_size;
+
+		// inserting first element on to the table which is 0,0
+		usTable.push_back(make_pair(0.0f, 0.0f));
+
+		float s = 0;
+		for (int u = 0; u < max_u; u++) {
+			step_size = 0.2;
+			float u_a = 0;
+			float u_b = 0;
+
+			// re-establish the control points accordingly for the segments
+			G[0] = glm::vec4(cps[u], 0);
+			G[1] = glm::vec4(cps[u + 1], 0);
+			G[2] = glm::vec4(cps[u + 2], 0);
+			G[3] = glm::vec4(cps[u + 3], 0);
+
+			while (u_a < 1) {
+				u_b = u_a + step_size;
+
+				glm::vec4 u_a_(1, u_a, u_a*u_a, u_a*u_a*u_a);
+				glm::vec4 u_b_(1, u_b, u_b*u_b, u_b*u_b*u_b);
+
+				glm::vec4 p_a = G*Bcr*u_a_;
+				glm::vec4 p_b = G*Bcr*u_b_;
+
+				s += glm::length(p_b - p_a);
+
+				u_a += step_size;
+
+				usTable.push_back(make_pair(u + u_a, s));
+			}
+		}
+		smax = s;
+	}
+}
+
+float Spline::s2u(float s) const
+{
+	float alpha = 0; // alpha = (s - s0) / (s1 - s0)
+
+	float s0 = 0;
+	float s1 = 1;
+
+	float u = 0;  // u = (1 - alpha)*u0 + alpha*u1
+	float u0 = 0;
+	float u1 = 0;
+
+	// find s0 and s1
+	for (size_t i = 1; i < usTable.size(); i++) {
+		float currentU = usTable[i].first;
+		float currentS = usTable[i].second;
+		if (currentS > s) {
+			u0 = usTable[i - 1].first;
+			s0 = usTable[i - 1].second;
+			u1 = currentU;
+			s1 = currentS;
+			alpha = (s - s0) / (s1 - s0);
+			u = (1 - alpha)*u0 + alpha*u1;
+			return u;
+		}
+	}
+	return 0.0f;
+}
+
+int Spline::segmentAt(float u, float &t) const
+{
+	int i = (int)floor(u);
+	t = (float)fmod(u, 1.0);
+	// The end of the last segment
+	if(i >= getSegmentCount()) {
+		i = getSegmentCount() - 1;
+		t = 1.0f;
+	}
+	return i;
+}
+
+glm::vec3 Spline::position(int segment, float t) const
+{
+	glm::mat4 G;
+	G[0] = glm::vec4(cps[segment], 0);
+	G[1] = glm::vec4(cps[segment + 1], 0);
+	G[2] = glm::vec4(cps[segment + 2], 0);
+	G[3] = glm::vec4(cps[segment + 3], 0);
+	glm::vec4 uVec(1, t, t*t, t*t*t);
+	glm::vec4 p = G*(Bcr*uVec);
+	return glm::vec3(p.x, p.y, p.z);
+}
+
+glm::vec3 Spline::position(float u) const
+{
+	float t;
+	int i = segmentAt(u, t);
+	return position(i, t);
+}
+
+glm::quat Spline::rotation(const vector<glm::quat> &rots, float u) const
+{
+	float t;
+	int i = segmentAt(u, t);
+	
+	// Flip quaternions onto the same hemisphere as their predecessor so the
+	// interpolation takes the short way around.
+	glm::mat4 Gq;
+	glm::quat k1 = rots[i];
+	glm::quat k2 = rots[i+1];
+	if (glm::dot(k1, k2) < 0) k2 = -k2;
+	glm::quat k3 = rots[i+2];
+	if (glm::dot(k2, k3) < 0) k3 = -k3;
+	glm::quat k4 = rots[i+3];
+	if (glm::dot(k3, k4) < 0) k4 = -k4;
+	Gq[0] = glm::vec4(k1.x, k1.y, k1.z, k1.w);
+	Gq[1] = glm::vec4(k2.x, k2.y, k2.z, k2.w);
+	Gq[2] = glm::vec4(k3.x, k3.y, k3.z, k3.w);
+	Gq[3] = glm::vec4(k4.x, k4.y, k4.z, k4.w);
+
+	glm::vec4 uVec(1, t, t*t, t*t*t);
+	glm::vec4 qVec = Gq * (Bcr * uVec);
+	glm::quat q(qVec[3], qVec[0], qVec[1], qVec[2]); // (w, x, y, z)
+	return glm::normalize(q);
+}
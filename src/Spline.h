@@ -0,0 +1,51 @@
+#pragma  once
+#ifndef __Spline__
+#define __Spline__
+
+#include <vector>
+#include <utility>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+/**
+ * Catmull-Rom spline through a list of control points
+ * - Segment i is defined by control points i..i+3, so there are ncps-3
+ *   segments and the spline parameter u runs over [0, ncps-3).
+ * - buildTable() builds the (u, s) arc-length table used by s2u() to move
+ *   along the curve at constant speed.
+ */
+class Spline
+{
+public:
+	Spline();
+	virtual ~Spline();
+	
+	void addControlPoint(const glm::vec3 &p);
+	const std::vector<glm::vec3> &getControlPoints() const { return cps; }
+	int getSegmentCount() const { return cps.size() >= 4 ? (int)cps.size() - 3 : 0; }
+	const glm::mat4 &getBasis() const { return Bcr; }
+	
+	void buildTable();
+	float getLength() const { return smax; }
+	float s2u(float s) const;
+	
+	// Point at local parameter t in [0, 1] of the given segment
+	glm::vec3 position(int segment, float t) const;
+	// Point at spline parameter u
+	glm::vec3 position(float u) const;
+	// Catmull-Rom interpolation of one unit quaternion per control point
+	glm::quat rotation(const std::vector<glm::quat> &rots, float u) const;
+	
+private:
+	// Splits u into a segment index and a local parameter in [0, 1]
+	int segmentAt(float u, float &t) const;
+	
+	glm::mat4 Bcr;
+	std::vector<glm::vec3> cps;
+	std::vector< std::pair<float, float> > usTable;
+	float smax;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "StreamBuffer.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "GLSL.h"
+#include "Trace.h"
+
+using namespace std;
+
+StreamBuffer::StreamBuffer() :
+	bufID(0),
+	segmentSize(0),
+	segment(0),
+	head(0),
+	mapped(NULL),
+	stalls(0)
+{
+	for(int i = 0; i < SEGMENTS; ++i) {
+		fences[i] = 0;
+	}
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	// Needs the context that init() ran in to still be current
+	for(int i = 0; i < SEGMENTS; ++i) {
+		if(fences[i]) {
+			glDeleteSync(fences[i]);
+		}
+	}
+	if(bufID) {
+		if(mapped) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, bufID);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &bufID);
+	}
+}
+
+void StreamBuffer::init(GLsizeiptr segmentSize)
+{
+	// Whole 256 byte blocks keep every segment aligned for any binding
+	this->segmentSize = (segmentSize + 255)/256*256;
+	segment = 0;
+	head = 0;
+	// Writes go through the copy target so other bindings are left alone
+	glGenBuffers(1, &bufID);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, bufID);
+	if(GLEW_ARB_buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, SEGMENTS*this->segmentSize, NULL, flags);
+		mapped = (char *)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, SEGMENTS*this->segmentSize, flags);
+	} else {
+		glBufferData(GL_COPY_WRITE_BUFFER, SEGMENTS*this->segmentSize, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	GLSL::checkError(GET_FILE_LINE);
+}
+
+void StreamBuffer::beginFrame()
+{
+	nextSegment();
+}
+
+void StreamBuffer::nextSegment()
+{
+	// Fence the draws that read the segment we are leaving
+	if(fences[segment]) {
+		glDeleteSync(fences[segment]);
+	}
+	fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	segment = (segment + 1) % SEGMENTS;
+	head = 0;
+	
+	GLsync fence = fences[segment];
+	if(fence) {
+		GLenum rc = glClientWaitSync(fence, 0, 0);
+		if(rc == GL_TIMEOUT_EXPIRED) {
+			TraceScope trace("StreamBuffer::wait");
+			++stalls;
+			do {
+				rc = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			} while(rc == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(fence);
+		fences[segment] = 0;
+	}
+}
+
+void StreamBuffer::reserve(GLsizeiptr size)
+{
+	assert(size <= segmentSize);
+	if(head + size > segmentSize) {
+		nextSegment();
+	}
+}
+
+GLintptr StreamBuffer::write(const void *data, GLsizeiptr size, GLint alignment)
+{
+	assert(size <= segmentSize);
+	head = (head + alignment - 1)/alignment*alignment;
+	if(head + size > segmentSize) {
+		nextSegment();
+	}
+	GLintptr offset = segment*segmentSize + head;
+	if(mapped) {
+		memcpy(mapped + offset, data, size);
+	} else {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, bufID);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	head += size;
+	return offset;
+}
@@ -0,0 +1,61 @@
+#pragma  once
+#ifndef __StreamBuffer__
+#define __StreamBuffer__
+
+#include <cstddef>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+/**
+ * Buffer for data written by the CPU every frame (per-draw uniforms,
+ * instance arrays)
+ * - The storage is split into SEGMENTS segments used round robin, one per
+ *   frame. Leaving a segment puts a fence behind the draws that read it, and
+ *   coming back to it waits on that fence, so the CPU never overwrites data
+ *   the GPU has not read yet. Normally the wait has long passed.
+ * - With ARB_buffer_storage the storage is mapped once, persistently and
+ *   coherently, and write() is a plain memcpy: no reallocation and no copy
+ *   in the driver. Without it, write() falls back to glBufferSubData.
+ * - A frame that fills its segment simply moves on to the next one.
+ * - The destructor unmaps and deletes the buffer and its fences, so it must
+ *   run while the GL context is current.
+ */
+class StreamBuffer
+{
+public:
+	enum {
+		SEGMENTS = 3
+	};
+	
+	StreamBuffer();
+	virtual ~StreamBuffer();
+	
+	// segmentSize is the most one frame normally writes
+	void init(GLsizeiptr segmentSize);
+	// Starts the next frame's segment
+	void beginFrame();
+	// Copies data into the current segment; returns its offset in the buffer
+	GLintptr write(const void *data, GLsizeiptr size, GLint alignment = 16);
+	// Makes the next writes, size bytes in all (padding included), land in
+	// the current segment, so one draw can read all of them
+	void reserve(GLsizeiptr size);
+	
+	GLuint getID() const { return bufID; }
+	bool isPersistent() const { return mapped != NULL; }
+	// Number of times the CPU had to wait for the GPU
+	unsigned long getStalls() const { return stalls; }
+	
+private:
+	void nextSegment();
+	
+	GLuint bufID;
+	GLsizeiptr segmentSize;
+	int segment;
+	GLintptr head; // within the current segment
+	char *mapped;
+	GLsync fences[SEGMENTS];
+	unsigned long stalls;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include "Trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+namespace Trace {
+
+struct Event
+{
+	char name[32];
+	char detail[64];
+	long long ts;
+	long long dur;
+};
+
+// Events of one thread, in a ring. Only the owning thread appends; count
+// is all events ever recorded (never wrapped). m is taken by the owner for
+// each event and by write() to copy the ring, so it is uncontended except
+// while a file is being written.
+struct ThreadBuffer
+{
+	enum { CAPACITY = 1 << 15 };
+	ThreadBuffer(int tid) : events(CAPACITY), count(0), tid(tid) {}
+	mutex m;
+	vector<Event> events;
+	size_t count;
+	int tid;
+};
+
+static atomic<bool> enabled(false);
+static const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+static mutex buffersMutex;
+static vector< shared_ptr<ThreadBuffer> > buffers; // kept alive after threads exit
+
+static ThreadBuffer *threadBuffer()
+{
+	static thread_local ThreadBuffer *buffer = NULL;
+	if(!buffer) {
+		lock_guard<mutex> lock(buffersMutex);
+		buffers.push_back(make_shared<ThreadBuffer>((int)buffers.size()));
+		buffer = buffers.back().get();
+	}
+	return buffer;
+}
+
+void setEnabled(bool e)
+{
+	enabled.store(e, memory_order_relaxed);
+}
+
+bool isEnabled()
+{
+	return enabled.load(memory_order_relaxed);
+}
+
+long long now()
+{
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - epoch).count();
+}
+
+static void copyString(char *dst, const char *src, size_t size)
+{
+	// JSON-safe copy: quotes and backslashes are replaced
+	size_t i = 0;
+	for(; src && src[i] && i + 1 < size; ++i) {
+		dst[i] = (src[i] == '"' || src[i] == '\\' || (unsigned char)src[i] < 0x20) ? '_' : src[i];
+	}
+	dst[i] = '\0';
+}
+
+void record(const char *name, long long start, long long end, const char *detail)
+{
+	if(!isEnabled()) {
+		return;
+	}
+	Event event;
+	copyString(event.name, name, sizeof(event.name));
+	copyString(event.detail, detail, sizeof(event.detail));
+	event.ts = start;
+	event.dur = end - start;
+	ThreadBuffer *buffer = threadBuffer();
+	lock_guard<mutex> lock(buffer->m);
+	buffer->events[buffer->count++ % ThreadBuffer::CAPACITY] = event;
+}
+
+bool write(const string &fileName)
+{
+	FILE *fp = fopen(fileName.c_str(), "w");
+	if(fp == NULL) {
+		cerr << "Cannot write " << fileName << endl;
+		return false;
+	}
+	lock_guard<mutex> lock(buffersMutex);
+	fprintf(fp, "{\"traceEvents\": [\n");
+	bool first = true;
+	size_t total = 0;
+	vector<Event> events;
+	for(size_t b = 0; b < buffers.size(); ++b) {
+		ThreadBuffer &buffer = *buffers[b];
+		// Copy the ring so the thread is held up only for the copy, not
+		// for the formatting
+		size_t n;
+		{
+			lock_guard<mutex> bufferLock(buffer.m);
+			events = buffer.events;
+			n = buffer.count;
+		}
+		size_t begin = n > ThreadBuffer::CAPACITY ? n - ThreadBuffer::CAPACITY : 0;
+		size_t written = 0;
+		for(size_t i = begin; i < n; ++i) {
+			const Event &event = events[i % ThreadBuffer::CAPACITY];
+			fprintf(fp, "%s{\"name\": \"%.*s\", \"ph\": \"X\", \"ts\": %lld, \"dur\": %lld, \"pid\": 1, \"tid\": %d",
+			        first ? "" : ",\n", (int)sizeof(event.name) - 1, event.name, event.ts, event.dur, buffer.tid);
+			if(event.detail[0]) {
+				fprintf(fp, ", \"args\": {\"detail\": \"%.*s\"}", (int)sizeof(event.detail) - 1, event.detail);
+			}
+			fprintf(fp, "}");
+			first = false;
+			++written;
+		}
+		total += written;
+		if(begin > 0) {
+			cerr << "Trace: thread " << buffer.tid << " overwrote its " << begin << " oldest events" << endl;
+		}
+	}
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+	cout << "Wrote " << total << " trace events to " << fileName << endl;
+	return true;
+}
+
+}
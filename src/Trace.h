@@ -0,0 +1,54 @@
+#pragma once
+#ifndef __Trace__
+#define __Trace__
+
+#include <string>
+
+/**
+ * Timeline tracing in the Chrome trace-event format (open the output in
+ * Perfetto or chrome://tracing).
+ * Every thread records into its own fixed-size ring behind its own lock,
+ * which only write() takes from outside, so recording never waits unless a
+ * file is being written. Once a ring is full the oldest events are
+ * overwritten, so a trace always holds the latest seconds of a long run.
+ * Recording is a single flag test while tracing is disabled.
+ */
+namespace Trace {
+
+	void setEnabled(bool enabled);
+	bool isEnabled();
+	// Microseconds since the process started tracing
+	long long now();
+	// Adds a complete event; name and detail are copied (and truncated)
+	void record(const char *name, long long start, long long end, const char *detail = 0);
+	// Writes the events still held (the newest of each thread's ring)
+	bool write(const std::string &fileName);
+}
+
+/**
+ * Records the enclosing block as a trace event. name and detail must stay
+ * valid until the end of the block.
+ */
+class TraceScope
+{
+public:
+	TraceScope(const char *name, const char *detail = 0) :
+		name(name),
+		detail(detail),
+		start(Trace::isEnabled() ? Trace::now() : -1)
+	{
+	}
+	~TraceScope()
+	{
+		if(start >= 0) {
+			Trace::record(name, start, Trace::now(), detail);
+		}
+	}
+	
+private:
+	const char *name;
+	const char *detail;
+	long long start;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#pragma  once
+#ifndef __TripleBuffer__
+#define __TripleBuffer__
+
+#include <atomic>
+
+/**
+ * Lock-free hand-off of the latest value from one writer thread to one
+ * reader thread. The writer fills the back slot and publishes it; the
+ * reader takes the newest published slot. Neither side ever waits, and a
+ * slot is never written while the reader holds it. Values the reader never
+ * got to are simply overwritten.
+ */
+template <class T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : back(0), middle(1), front(2) {}
+	
+	// Writer
+	T &getBack() { return slots[back]; }
+	void publish() { back = middle.exchange(back | FRESH) & INDEX; }
+	
+	// Reader: switches to the newest published value, if there is one
+	const T &getFront()
+	{
+		if(middle.load() & FRESH) {
+			front = middle.exchange(front) & INDEX;
+		}
+		return slots[front];
+	}
+	
+private:
+	enum {
+		INDEX = 3,
+		FRESH = 4
+	};
+	
+	T slots[3];
+	int back;
+	std::atomic<int> middle; // index of the spare slot, FRESH if published
+	int front;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "UniformBuffer.h"
+
+#include <cassert>
+#include <cstddef>
+
+#include "GLSL.h"
+
+using namespace std;
+
+UniformBuffer::UniformBuffer() :
+	bufID(0),
+	binding(0),
+	capacity(0),
+	alignment(256)
+{
+	
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	if(bufID) {
+		glDeleteBuffers(1, &bufID);
+	}
+}
+
+void UniformBuffer::init(GLuint binding, GLsizeiptr size, bool perDraw)
+{
+	this->binding = binding;
+	capacity = size;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if(perDraw) {
+		stream.init(capacity);
+	} else {
+		glGenBuffers(1, &bufID);
+		glBindBuffer(GL_UNIFORM_BUFFER, bufID);
+		glBufferData(GL_UNIFORM_BUFFER, capacity, NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	GLSL::checkError(GET_FILE_LINE);
+}
+
+void UniformBuffer::update(const void *data, GLsizeiptr size, GLintptr offset)
+{
+	assert(bufID != 0 && offset + size <= capacity);
+	glBindBuffer(GL_UNIFORM_BUFFER, bufID);
+	glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::bind() const
+{
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, bufID);
+}
+
+void UniformBuffer::beginFrame()
+{
+	stream.beginFrame();
+}
+
+void UniformBuffer::push(const void *data, GLsizeiptr size)
+{
+	assert(size <= capacity);
+	// Slots must start on an offset the driver accepts for binding
+	GLintptr offset = stream.write(data, size, alignment);
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, stream.getID(), offset, size);
+}
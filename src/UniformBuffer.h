@@ -0,0 +1,50 @@
+#pragma  once
+#ifndef __UniformBuffer__
+#define __UniformBuffer__
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include "StreamBuffer.h"
+
+/**
+ * An OpenGL uniform buffer object (std140 block storage)
+ * - update()/bind() for data shared by all draws (e.g. camera matrices)
+ * - beginFrame()/push() for per-draw data (init() with perDraw), each push
+ *   landing in its own aligned slot of a StreamBuffer that is bound with
+ *   glBindBufferRange
+ */
+class UniformBuffer
+{
+public:
+	// Binding points shared by all programs
+	enum {
+		CAMERA_BLOCK = 0,
+		OBJECT_BLOCK
+	};
+	
+	UniformBuffer();
+	virtual ~UniformBuffer();
+	
+	// With perDraw, size is the most one frame pushes and only the stream
+	// is allocated; otherwise only the shared buffer is
+	void init(GLuint binding, GLsizeiptr size, bool perDraw = false);
+	void update(const void *data, GLsizeiptr size, GLintptr offset = 0);
+	void bind() const;
+	
+	void beginFrame();
+	void push(const void *data, GLsizeiptr size);
+	
+	GLuint getBinding() const { return binding; }
+	
+	const StreamBuffer &getStream() const { return stream; }
+	
+private:
+	GLuint bufID;
+	GLuint binding;
+	GLsizeiptr capacity;
+	GLint alignment;
+	StreamBuffer stream;
+};
+
+#endif
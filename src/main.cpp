@@ -1,5 +1,8 @@
 #include <iostream>
 #include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 
 #define GLEW_STATIC
 #include <GL/glew.h>
@@ -18,170 +21,301 @@
 #include "Shape.h"
 #include "Helicopter.h"
 #include "KeyFrame.h"
+#include "UniformBuffer.h"
+#include "ShaderWatcher.h"
+#include "Headless.h"
+#include "FrameClock.h"
+#include "Profiler.h"
+#include "Trace.h"
+#include "Spline.h"
+#include "GLState.h"
+#include "RenderQueue.h"
+#include "JobSystem.h"
+#include "Fleet.h"
+#include "PoseTrack.h"
+#include "Easing.h"
+#include "Simulation.h"
+#include "MeshArena.h"
+#include "SoftRenderer.h"
+#include "InputLog.h"
+#include "Picker.h"
 
 #define M_PI       3.14159265358979323846   // pi
 
+static const double BAKE_RATE = 240.0; // Poses per second in baked tracks
+static const double PATH_PERIOD = 10.0; // pathPose() repeats every PATH_PERIOD seconds
+// Keyframes per job: each is a few matrix products, so small sets stay in
+// one job and only thousands of keyframes are spread over the threads
+static const int KEYFRAME_GRAIN = 64;
+// --compare-soft passes while at most this fraction of the pixels is off:
+// pixels on a triangle edge may be covered by only one of the renderers
+static const double COMPARE_MAX_OFF = 0.005;
+
 using namespace std;
 
 bool keyToggles[256] = {false}; // only for English keyboards!
 
-GLFWwindow *window; // Main application window
+GLFWwindow *window = NULL; // Main application window (NULL when headless)
+shared_ptr<Headless> headless; // Offscreen target when there is no window
+shared_ptr<FrameClock> frameClock; // Sampled once per frame
+shared_ptr<InputLog> inputLog; // While recording or replaying input
 string RESOURCE_DIR = ""; // Where the resources are loaded from
 
 shared_ptr<Program> progNormal;
 shared_ptr<Program> progSimple;
+shared_ptr<Program> progInstanced; // Fleet mode only
+shared_ptr<Program> progIndirect; // progNormal for multi-draw indirect batches
+shared_ptr<Program> progCull; // Frustum culling of the fleet (compute)
 shared_ptr<Camera> camera;
 shared_ptr<Helicopter> helicopter;
+shared_ptr<UniformBuffer> cameraUBO; // P and V, shared by all programs
+shared_ptr<UniformBuffer> objectUBO; // M, one slot per draw
+shared_ptr<ShaderWatcher> shaderWatcher;
+shared_ptr<Spline> spline; // Path through the keyframe positions
+shared_ptr<PoseTrack> poseTrack; // Baked path played back instead of the spline (--play)
+shared_ptr<Easing> easing; // Time control toggled with 'q' (--easing replaces it)
+atomic<bool> easeEnabled(false); // 'q', readable from the simulation thread
+shared_ptr<Simulation> simulation; // Animation on its own thread (--sim HZ)
+double simRate = 0.0;
+SimState frameState; // Simulated in the frame when there is no simulation thread
+shared_ptr<RenderQueue> renderQueue; // Mesh draws, sorted and flushed once per frame
+shared_ptr<JobSystem> jobs; // Worker threads for CPU work (loading, posing, recording draws)
+int jobThreads = 0; // 0 = one per hardware thread
+shared_ptr<Fleet> fleet; // Extra helicopters flying the path (--fleet N)
+int fleetSize = 0;
+bool cullEnabled = true; // --no-cull draws the whole fleet
+shared_ptr<MeshArena> meshArena; // Static meshes drawn with multi-draw indirect
+bool indirectEnabled = true; // --no-indirect turns it off
+bool linesEnabled = true; // --no-lines leaves out the axes, grid and spline
+shared_ptr<Picker> picker; // Alt-click selection of keyframes and control points
+glm::mat4 pickP, pickV; // Camera of the last frame, which the cursor points into
+int pickWidth = 1, pickHeight = 1; // Window size of the last frame
+
+shared_ptr<Profiler> profiler;
+string profileName; // JSON file for the profiler stats on exit
+string traceName; // Chrome trace file, written on exit and with 't'
+
+// Profiler sections
+int profFrame;
+int profGrid;
+int profSpline;
+int profHelicopter;
+int profKeyframes;
+int profQueue;
+int profSimulate;
+int profFleet;
 
 glm::mat4 helicopter_matrix;
-glm::mat4 Bcr;
 
-vector<glm::vec3> cps;
 vector<KeyFrame> keyframes;
-vector<pair<float, float> > usTable;
-
-float smax;
+vector<glm::quat> keyframeRots; // Rotation of each keyframe, for spline->rotation()
 
 static void error_callback(int error, const char *description)
 {
 	cerr << description << endl;
 }
 
-static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
+// Input handlers. The GLFW callbacks below call them with live input, and
+// replayInput() with the events of a recorded session.
+
+static void onKey(int key, int action, int mods)
 {
-	if(key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
+	if(key == GLFW_KEY_ESCAPE && action == GLFW_PRESS && window) {
 		glfwSetWindowShouldClose(window, GL_TRUE);
 	}
 }
 
-static void char_callback(GLFWwindow *window, unsigned int key)
+static void onChar(unsigned int key)
 {
+	if(key >= 256) {
+		return;
+	}
 	keyToggles[key] = !keyToggles[key];
+	if(key == 'q') {
+		easeEnabled = keyToggles[key];
+	}
+	if(key == 'p' && profiler) { // not in software runs
+		profiler->print();
+		GLState::printCounters();
+		renderQueue->printStats();
+		if(fleet) {
+			fleet->printStats();
+		}
+	}
+	if(key == 't' && Trace::isEnabled()) {
+		Trace::write(traceName);
+	}
 }
 
-static void cursor_position_callback(GLFWwindow* window, double xmouse, double ymouse)
+static void onCursor(double xmouse, double ymouse, bool dragging)
 {
-	int state = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT);
-	if(state == GLFW_PRESS) {
+	if(dragging) {
 		camera->mouseMoved(xmouse, ymouse);
 	}
 }
 
-void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+// Reports the keyframe or control point under the cursor
+static void pick(double xmouse, double ymouse)
+{
+	bool cps = keyToggles[(unsigned)'k'];
+	if(!picker || !(cps || keyToggles[(unsigned)'K'])) {
+		cout << "Show the keyframes ('k' or 'K') to pick them" << endl;
+		return;
+	}
+	auto start = chrono::steady_clock::now();
+	glm::vec3 origin, dir;
+	Picker::unproject((float)xmouse, (float)ymouse, pickWidth, pickHeight, pickP, pickV, origin, dir);
+	// Control points sit inside their keyframes' helicopters, so a ray
+	// through one picks it. The keyframes never spin their propellers.
+	Picker::Hit hit;
+	bool found = (cps && picker->pickControlPoint(origin, dir, hit)) ||
+	             picker->pickKeyFrame(origin, dir, FrameTime(), hit);
+	double us = 1e6*chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	if(!found) {
+		cout << "Nothing picked (" << us << " us)" << endl;
+		return;
+	}
+	cout << "Picked " << (hit.type == Picker::KEYFRAME ? "keyframe " : "control point ") << hit.index
+	     << " at (" << hit.point.x << ", " << hit.point.y << ", " << hit.point.z << ") in " << us << " us" << endl;
+}
+
+static void onButton(int button, int action, int mods, double xmouse, double ymouse)
 {
-	// Get the current mouse position.
-	double xmouse, ymouse;
-	glfwGetCursorPos(window, &xmouse, &ymouse);
-	// Get current window size.
-	int width, height;
-	glfwGetWindowSize(window, &width, &height);
 	if (action == GLFW_PRESS) {
 		bool shift = mods & GLFW_MOD_SHIFT;
 		bool ctrl = mods & GLFW_MOD_CONTROL;
 		bool alt = mods & GLFW_MOD_ALT;
 		camera->mouseClicked(xmouse, ymouse, shift, ctrl, alt);
+		if(alt) {
+			pick(xmouse, ymouse);
+		}
 	}
 }
 
-void buildTable()
+// Applies the recorded input of a frame, before it is rendered
+static void replayInput(const FrameTime &time)
 {
-	float max_u = cps.size() - 3; // this is because ther eare 8 points and so 8 - 3 = 5
-
-	if (cps.size() >= 4) {
-		glm::mat4 G;
-		float step_size;
-
-		// inserting first element on to the table which is 0,0
-		usTable.push_back(make_pair(0.0f, 0.0f));
-
-		float s = 0;
-		for (int u = 0; u < max_u; u++) {
-			step_size = 0.2;
-			float u_a = 0;
-			float u_b = 0;
-
-			// re-establish the control points accordingly for the segments
-			G[0] = glm::vec4(cps[u], 0);
-			G[1] = glm::vec4(cps[u + 1], 0);
-			G[2] = glm::vec4(cps[u + 2], 0);
-			G[3] = glm::vec4(cps[u + 3], 0);
-
-			while (u_a < 1) {
-				u_b = u_a + step_size;
+	InputLog::Event e;
+	while(inputLog->next(time.frame, e)) {
+		switch(e.type) {
+			case InputLog::KEY:
+				onKey(e.code, e.action, e.mods);
+				break;
+			case InputLog::CHAR:
+				onChar((unsigned int)e.code);
+				break;
+			case InputLog::CURSOR:
+				onCursor(e.x, e.y, e.action != 0);
+				break;
+			case InputLog::BUTTON:
+				onButton(e.code, e.action, e.mods, e.x, e.y);
+				break;
+		}
+	}
+}
 
-				glm::vec4 u_a_(1, u_a, u_a*u_a, u_a*u_a*u_a);
-				glm::vec4 u_b_(1, u_b, u_b*u_b, u_b*u_b*u_b);
+// While replaying, live input is ignored (except Escape in key_callback)
+static bool isReplaying()
+{
+	return inputLog && inputLog->isReplaying();
+}
 
-				glm::vec4 p_a = G*Bcr*u_a_;
-				glm::vec4 p_b = G*Bcr*u_b_;
+static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+	if(isReplaying() && key != GLFW_KEY_ESCAPE) {
+		return;
+	}
+	if(inputLog) {
+		inputLog->add(InputLog::KEY, key, action, mods);
+	}
+	onKey(key, action, mods);
+}
 
-				s += glm::length(p_b - p_a);
+static void char_callback(GLFWwindow *window, unsigned int key)
+{
+	if(isReplaying()) {
+		return;
+	}
+	if(inputLog) {
+		inputLog->add(InputLog::CHAR, key);
+	}
+	onChar(key);
+}
 
-				u_a += step_size;
+static void cursor_position_callback(GLFWwindow* window, double xmouse, double ymouse)
+{
+	if(isReplaying()) {
+		return;
+	}
+	bool dragging = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+	if(inputLog) {
+		inputLog->add(InputLog::CURSOR, 0, dragging, 0, xmouse, ymouse);
+	}
+	onCursor(xmouse, ymouse, dragging);
+}
 
-				usTable.push_back(make_pair(u + u_a, s));
-			}
-		}
-		smax = s;
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+	if(isReplaying()) {
+		return;
 	}
-	else {
-		usTable.clear();
+	// Get the current mouse position.
+	double xmouse, ymouse;
+	glfwGetCursorPos(window, &xmouse, &ymouse);
+	if(inputLog) {
+		inputLog->add(InputLog::BUTTON, button, action, mods, xmouse, ymouse);
 	}
+	onButton(button, action, mods, xmouse, ymouse);
 }
 
-float s2u(float s)
+// Picking structures for the keyframes (drawn under the identity) and the
+// control points. The keyframes need their helicopter.
+static void initPicker()
 {
-	float alpha = 0; // alpha = (s - s0) / (s1 - s0)
-
-	float s0 = 0;
-	float s1 = 1;
-
-	float u = 0;  // u = (1 - alpha)*u0 + alpha*u1
-	float u0 = 0;
-	float u1 = 0;
-
-	// find s0 and s1
-	for (int i = 0; i < usTable.size(); i++) {
-		float currentU = usTable[i].first;
-		float currentS = usTable[i].second;
-		if (currentS > s) {
-			u0 = usTable[i - 1].first;
-			s0 = usTable[i - 1].second;
-			u1 = currentU;
-			s1 = currentS;
-			alpha = (s - s0) / (s1 - s0);
-			u = (1 - alpha)*u0 + alpha*u1;
-			return u;
-		}
+	vector<glm::mat4> poses;
+	for (int i = 0; i < (int)keyframes.size(); i++) {
+		poses.push_back(glm::translate(glm::mat4(1.0f), keyframes[i].getPos()) * glm::toMat4(keyframes[i].getRot()));
 	}
-	return 0.0f;
-	
+	picker = make_shared<Picker>();
+	picker->setKeyFrames(poses, *helicopter);
+	picker->setControlPoints(spline->getControlPoints(), 0.1f);
 }
 
 static void init()
 {
+	TraceScope trace("init");
 	GLSL::checkVersion();
+#if GLSL_CHECK_ERRORS
+	// Let the driver report errors instead of polling glGetError
+	if(GLSL::enableDebugOutput()) {
+		cout << "Using KHR_debug output" << endl;
+	}
+#endif
+	if(!GLEW_ARB_uniform_buffer_object) {
+		cerr << "Uniform buffer objects are not supported" << endl;
+		exit(-1);
+	}
 	
 	// Set background color
 	glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 	// Enable z-buffer test
-	glEnable(GL_DEPTH_TEST);
+	GLState::enable(GL_DEPTH_TEST);
 	
 	keyToggles[(unsigned)'c'] = true;
-
-	Bcr[0] = glm::vec4(0.0f, 2.0f, 0.0f, 0.0f);
-	Bcr[1] = glm::vec4(-1.0f, 0.0f, 1.0f, 0.0f);
-	Bcr[2] = glm::vec4(2.0f, -5.0f, 4.0f, -1.0f);
-	Bcr[3] = glm::vec4(-1.0f, 3.0f, -3.0f, 1.0f);
-	Bcr *= 0.5;
+	
+	// The simulation thread is the second outside thread
+	jobs = make_shared<JobSystem>(jobThreads, 2);
+	
+	// Reuse linked programs from previous runs when the sources are unchanged
+	Program::setBinaryCacheDir(RESOURCE_DIR);
 	
 	// For drawing the Helicopter
 	progNormal = make_shared<Program>();
 	progNormal->setShaderNames(RESOURCE_DIR + "normal_vert.glsl", RESOURCE_DIR + "normal_frag.glsl");
 	progNormal->setVerbose(true);
 	progNormal->init();
-	progNormal->addUniform("P");
-	progNormal->addUniform("MV");
+	progNormal->addUniformBlock("Camera", UniformBuffer::CAMERA_BLOCK);
+	progNormal->addUniformBlock("Object", UniformBuffer::OBJECT_BLOCK);
 	progNormal->addAttribute("aPos");
 	progNormal->addAttribute("aNor");
 	progNormal->setVerbose(false);
@@ -191,15 +325,140 @@ static void init()
 	progSimple->setShaderNames(RESOURCE_DIR + "simple_vert.glsl", RESOURCE_DIR + "simple_frag.glsl");
 	progSimple->setVerbose(true);
 	progSimple->init();
-	progSimple->addUniform("P");
-	progSimple->addUniform("MV");
+	progSimple->addUniformBlock("Camera", UniformBuffer::CAMERA_BLOCK);
+	progSimple->addUniformBlock("Object", UniformBuffer::OBJECT_BLOCK);
 	progSimple->setVerbose(false);
 	
+	// For drawing the fleet, one instance per helicopter
+	if(fleetSize > 0 && !Fleet::isSupported()) {
+		cerr << "Instancing is not supported, ignoring --fleet" << endl;
+		fleetSize = 0;
+	}
+	if(fleetSize > 0) {
+		progInstanced = make_shared<Program>();
+		progInstanced->setShaderNames(RESOURCE_DIR + "instanced_vert.glsl", RESOURCE_DIR + "normal_frag.glsl");
+		progInstanced->setVerbose(true);
+		progInstanced->init();
+		progInstanced->addUniformBlock("Camera", UniformBuffer::CAMERA_BLOCK);
+		progInstanced->addUniformBlock("Object", UniformBuffer::OBJECT_BLOCK);
+		progInstanced->addAttribute("aPos");
+		progInstanced->addAttribute("aNor");
+		progInstanced->addAttribute("aInstPos");
+		progInstanced->addAttribute("aInstRot");
+		progInstanced->setVerbose(false);
+	}
+	if(fleetSize > 0 && cullEnabled && !InstanceCuller::isSupported()) {
+		cerr << "Compute shaders are not supported, the fleet is not culled" << endl;
+		cullEnabled = false;
+	}
+	if(fleetSize > 0 && cullEnabled) {
+		progCull = make_shared<Program>();
+		progCull->setComputeShaderName(RESOURCE_DIR + "cull_comp.glsl");
+		progCull->setVerbose(true);
+		progCull->init();
+		progCull->setVerbose(false);
+	}
+	
+	// Helicopter parts batched into multi-draw indirect calls
+	if(indirectEnabled && !MeshArena::isSupported()) {
+		cerr << "Multi-draw indirect is not supported, drawing meshes one by one" << endl;
+		indirectEnabled = false;
+	}
+	if(indirectEnabled) {
+		progIndirect = make_shared<Program>();
+		progIndirect->setShaderNames(RESOURCE_DIR + "indirect_vert.glsl", RESOURCE_DIR + "normal_frag.glsl");
+		progIndirect->setVerbose(true);
+		progIndirect->init();
+		progIndirect->addUniformBlock("Camera", UniformBuffer::CAMERA_BLOCK);
+		progIndirect->addAttribute("aPos");
+		progIndirect->addAttribute("aNor");
+		progIndirect->addAttribute("aM");
+		progIndirect->setVerbose(false);
+	}
+	
+	// Reload edited shaders while running
+	shaderWatcher = make_shared<ShaderWatcher>();
+	if(shaderWatcher->init(RESOURCE_DIR)) {
+		shaderWatcher->addProgram(progNormal);
+		shaderWatcher->addProgram(progSimple);
+		if(progInstanced) {
+			shaderWatcher->addProgram(progInstanced);
+		}
+		if(progIndirect) {
+			shaderWatcher->addProgram(progIndirect);
+		}
+		if(progCull) {
+			shaderWatcher->addProgram(progCull);
+		}
+	}
+	
+	// Camera block holds P and V; the object block streams one 256 byte
+	// slot per draw, 256 draws per frame before it moves to the next segment.
+	cameraUBO = make_shared<UniformBuffer>();
+	cameraUBO->init(UniformBuffer::CAMERA_BLOCK, 2*sizeof(glm::mat4));
+	objectUBO = make_shared<UniformBuffer>();
+	objectUBO->init(UniformBuffer::OBJECT_BLOCK, 256*256, true);
+	renderQueue = make_shared<RenderQueue>(objectUBO, jobs->getCount());
+	
 	helicopter_matrix = glm::mat4();
 	helicopter = make_shared<Helicopter>();
-	helicopter->init(RESOURCE_DIR, "helicopter_body1.obj", "helicopter_body2.obj", "helicopter_prop1.obj", "helicopter_prop2.obj");
+	helicopter->init(jobs, RESOURCE_DIR, "helicopter_body1.obj", "helicopter_body2.obj", "helicopter_prop1.obj", "helicopter_prop2.obj");
+	if(indirectEnabled) {
+		meshArena = make_shared<MeshArena>();
+		helicopter->addMeshes(*meshArena);
+		meshArena->init();
+		renderQueue->setIndirect(meshArena, progNormal, progIndirect);
+	}
 
+	for (int i = 0; i < keyframes.size(); i++) {
+		keyframes[i].setHelicopter(helicopter);
+	}
+	initPicker();
+	
+	if(fleetSize > 0) {
+		fleet = make_shared<Fleet>();
+		// Every preset plus the 'q' curve, picked at random per helicopter
+		vector<Easing> profiles;
+		for (int i = 0; i < Easing::PRESETS; i++) {
+			profiles.push_back(Easing::preset(i));
+		}
+		profiles.push_back(*easing);
+		fleet->init(fleetSize, spline, keyframeRots, profiles);
+		fleet->initGL();
+		if(progCull) {
+			fleet->initCulling(progCull, *helicopter);
+		}
+	}
+
+	camera = make_shared<Camera>();
+	
+	// The whole frame is CPU only, since GPU timer queries cannot nest.
+	profiler = make_shared<Profiler>();
+	profFrame = profiler->addSection("frame", false);
+	profGrid = profiler->addSection("grid", true);
+	profSpline = profiler->addSection("spline", true);
+	// The mesh passes only submit to the render queue; the GPU time is in "queue"
+	profHelicopter = profiler->addSection("helicopter", false);
+	profKeyframes = profiler->addSection("keyframes", false);
+	profQueue = profiler->addSection("queue", true);
+	profSimulate = profiler->addSection("simulate", false);
+	profFleet = profiler->addSection("fleet", true);
+	
+	// Initialize time.
+	frameClock->reset();
+	
+	// If there were any OpenGL errors, this will print something.
+	// You can intersperse this line in your code to find the exact location
+	// of your OpenGL error.
+	GLSL::checkError(GET_FILE_LINE);
+}
+
+// The path and its keyframes. Needs no GL, so the path can be baked without
+// a context; init() gives the keyframes their helicopter.
+void initPath()
+{
 	//initialize the 7 keyframes & control points
+	vector<glm::vec3> cps;
 	cps.push_back(glm::vec3(0, 0, 0));
 	cps.push_back(glm::vec3(-2, 3, -3));
 	cps.push_back(glm::vec3(-1.5, 6, -3));
@@ -208,49 +467,56 @@ static void init()
 	cps.push_back(cps[0]);
 	cps.push_back(cps[1]);
 	cps.push_back(cps[2]);
-	keyframes.push_back(KeyFrame(helicopter, cps[0], 31.0f, 0, 1, 0)); // first
-	keyframes.push_back(KeyFrame(helicopter, cps[1], 165.0f, 1, 0, 0)); // second
-	keyframes.push_back(KeyFrame(helicopter, cps[2], 185.0f, 0, 0, 1));
-	keyframes.push_back(KeyFrame(helicopter, cps[3], 10.0f, 0, 1, 0));
-	keyframes.push_back(KeyFrame(helicopter, cps[4], 200.0f, 0, 0, 1));
+	const float degrees[5] = { 31.0f, 165.0f, 185.0f, 10.0f, 200.0f };
+	const glm::vec3 axes[5] = { glm::vec3(0, 1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1) };
+	for (int i = 0; i < 5; i++) {
+		KeyFrame keyframe;
+		keyframe.setPos(cps[i]);
+		keyframe.setRot(degrees[i], axes[i]);
+		keyframes.push_back(keyframe);
+	}
 	keyframes.push_back(keyframes[0]);
 	keyframes.push_back(keyframes[1]);
 	keyframes.push_back(keyframes[2]);
 
-	buildTable();
+	spline = make_shared<Spline>();
+	for (int i = 0; i < cps.size(); i++) {
+		spline->addControlPoint(cps[i]);
+		keyframeRots.push_back(keyframes[i].getRot());
+	}
+	spline->buildTable();
+}
 
-	camera = make_shared<Camera>();
-	
-	// Initialize time.
-	glfwSetTime(0.0);
-	
-	// If there were any OpenGL errors, this will print something.
-	// You can intersperse this line in your code to find the exact location
-	// of your OpenGL error.
-	GLSL::checkError(GET_FILE_LINE);
+// Pose of the helicopter on the path at time t, optionally eased
+void pathPose(double t, const Easing *ease, glm::vec3 &p, glm::quat &q)
+{
+	// Easings run over [0, 1], so one period maps onto the whole loop
+	float tmax = PATH_PERIOD;
+	float tNorm = std::fmod(t, tmax)/tmax;
+	float sNorm;
+	if (ease) {
+		sNorm = ease->evaluate(tNorm);
+	}else {
+		sNorm = tNorm;
+	}
+	float s = spline->getLength()*sNorm;
+	float u = spline->s2u(s);
+	p = spline->position(u);
+	q = spline->rotation(keyframeRots, u);
 }
 
 void catmull_rom_spline() {
 
-	glm::mat4 G;
-	int ncps = cps.size();
 	float u;
 	float stepsize = 0.01;
 	
 	glColor3f(0, 0, 0);
 	glBegin(GL_LINE_STRIP);
 	// will jump for every four points
-	for (int i = 0; i < ncps - 3; i += 1) {
-
-		G[0] = glm::vec4(cps[i], 0);
-		G[1] = glm::vec4(cps[i + 1], 0);
-		G[2] = glm::vec4(cps[i + 2], 0);
-		G[3] = glm::vec4(cps[i + 3], 0);
+	for (int i = 0; i < spline->getSegmentCount(); i += 1) {
 		u = 0;
 		while (u <= 1) {
-			if (u > 1) u = 1;
-			glm::vec4 ubar(1, u, u*u, u*u*u);
-			glm::vec4 p = G*(Bcr*ubar);
+			glm::vec3 p = spline->position(i, u);
 			glVertex3f(p.x, p.y, p.z);
 			u += stepsize;
 		}
@@ -258,171 +524,527 @@ void catmull_rom_spline() {
 	glEnd();
 }
 
-void interpolate(shared_ptr<Program> prog, shared_ptr<MatrixStack> MV, float u) {
-	int i = (int)floor(u);
-	
-	glm::mat4 Gp;
-	Gp[0] = glm::vec4(cps[i], 0);
-	Gp[1] = glm::vec4(cps[i + 1], 0);
-	Gp[2] = glm::vec4(cps[i + 2], 0);
-	Gp[3] = glm::vec4(cps[i + 3], 0);
-
-	glm::mat4 Gq;
-	glm::quat k1 = keyframes[i].getRot();
-	glm::quat k2 = keyframes[i+1].getRot();
-	if (glm::dot(k1, k2) < 0) k2 = -k2;
-	glm::quat k3 = keyframes[i+2].getRot();
-	if (glm::dot(k2, k3) < 0) k3 = -k3;
-	glm::quat k4 = keyframes[i+3].getRot();
-	if (glm::dot(k3, k4) < 0) k4 = -k4;
-	Gq[0] = glm::vec4(k1.x, k1.y, k1.z, k1.w);
-	Gq[1] = glm::vec4(k2.x, k2.y, k2.z, k2.w);
-	Gq[2] = glm::vec4(k3.x, k3.y, k3.z, k3.w);
-	Gq[3] = glm::vec4(k4.x, k4.y, k4.z, k4.w);
-
-	u = fmod(u, 1.0);
-	glm::vec4 uVec(1, u, u*u, u*u*u);
-	glm::vec4 p = Gp*Bcr*uVec;
-	
-	glm::vec4 qVec = Gq * (Bcr * uVec);
-	glm::quat q(qVec[3], qVec[0], qVec[1], qVec[2]); // (w, x, y, z)
-	helicopter_matrix = glm::toMat4(glm::normalize(q));
-	helicopter_matrix[3] = glm::vec4(p.x, p.y, p.z, 1.0f);
-
-	
-	MV->pushMatrix();
-	MV->multMatrix(helicopter_matrix);
-	helicopter->draw(prog, MV);
-	MV->popMatrix();
+// One animation step: the helicopter's pose and the fleet. Makes no GL
+// calls; runs on the simulation thread when there is one.
+void simulate(double t, double dt, SimState &state)
+{
+	if (poseTrack) {
+		poseTrack->pose(t, state.p, state.q);
+	} else {
+		pathPose(t, easeEnabled ? easing.get() : NULL, state.p, state.q);
+	}
+	if (fleet) {
+		fleet->update(*jobs, (float)dt, state.fleet);
+	}
+}
+
+void interpolate(shared_ptr<Program> prog, shared_ptr<MatrixStack> M, CommandList &list, const SimState &state, const FrameTime &time) {
+	helicopter_matrix = glm::toMat4(state.q);
+	helicopter_matrix[3] = glm::vec4(state.p.x, state.p.y, state.p.z, 1.0f);
+
+	M->pushMatrix();
+	M->multMatrix(helicopter_matrix);
+	helicopter->draw(prog, M, list, time);
+	M->popMatrix();
 }
 
-void render()
+// Pushes this frame's projection and view, shared by the GL and software
+// renderers. Needs helicopter_matrix for the lookAt views.
+static void applyCamera(float aspect, shared_ptr<MatrixStack> P, shared_ptr<MatrixStack> V)
 {
-	// Update time.
-	double t = glfwGetTime();
-	float tmax = 10;
-	float tNorm = std::fmod(t, tmax)/(tmax+1);
-	float sNorm;
-	if (keyToggles[(unsigned)'q']) {
-		sNorm = 117.03*tNorm*tNorm*tNorm*tNorm*tNorm - 335.24*tNorm*tNorm*tNorm*tNorm + 338.13*tNorm*tNorm*tNorm - 140.76*tNorm*tNorm + 20.838*tNorm - 4.1E-11;
-	}else {
-		sNorm = tNorm;
+	camera->setAspect(aspect);
+	P->pushMatrix();
+	camera->applyProjectionMatrix(P);
+	V->pushMatrix();
+	if (keyToggles[(unsigned)' ']) {  // you can click 'v' in order to change between two different lookAt() views
+		if (keyToggles[(unsigned)'v'])
+			camera->applyLookAtMatrix(V, helicopter_matrix, 0, 0, 0.1);
+		else
+			camera->applyLookAtMatrix(V, helicopter_matrix, 0, 0, -5);
+	} 
+	else
+		camera->applyViewMatrix(V);
+}
+
+void render(const FrameTime &time)
+{
+	ProfileScope frameScope(*profiler, profFrame);
+	
+	// Latest state from the simulation thread, or simulate this frame
+	const SimState *sim = &frameState;
+	if(simulation) {
+		sim = &simulation->latest();
+	} else {
+		profiler->begin(profSimulate);
+		simulate(time.t, time.dt, frameState);
+		profiler->end(profSimulate);
 	}
-	float s = smax*sNorm;
-	float u = s2u(s);
 	
 	// Get current frame buffer size.
 	int width, height;
-	glfwGetFramebufferSize(window, &width, &height);
-	glViewport(0, 0, width, height);
+	if(window) {
+		glfwGetFramebufferSize(window, &width, &height);
+	} else {
+		width = headless->getWidth();
+		height = headless->getHeight();
+	}
+	GLState::viewport(0, 0, width, height);
 	
 	// Use the window size for camera.
-	glfwGetWindowSize(window, &width, &height);
-	camera->setAspect((float)width/(float)height);
-	
+	if(window) {
+		glfwGetWindowSize(window, &width, &height);
+	}
 	// Clear buffers
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	unsigned state = 0;
 	if(keyToggles[(unsigned)'c']) {
-		glEnable(GL_CULL_FACE);
+		GLState::enable(GL_CULL_FACE);
+		state |= RenderQueue::CULL;
 	} else {
-		glDisable(GL_CULL_FACE);
+		GLState::disable(GL_CULL_FACE);
 	}
 	if(keyToggles[(unsigned)'l']) {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		GLState::polygonMode(GL_LINE);
+		state |= RenderQueue::WIREFRAME;
 	} else {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		GLState::polygonMode(GL_FILL);
 	}
+	renderQueue->setState(state);
 	
 	auto P = make_shared<MatrixStack>();
-	auto MV = make_shared<MatrixStack>();
+	auto V = make_shared<MatrixStack>();
+	auto M = make_shared<MatrixStack>();
 	
 	// Apply camera transforms
-	P->pushMatrix();
-	camera->applyProjectionMatrix(P);
-	MV->pushMatrix();
+	applyCamera((float)width/(float)height, P, V);
+	pickP = P->topMatrix();
+	pickV = V->topMatrix();
+	pickWidth = width;
+	pickHeight = height;
+	
+	// Send the camera matrices once for all programs
+	glm::mat4 cameraBlock[2] = { P->topMatrix(), V->topMatrix() };
+	cameraUBO->update(cameraBlock, sizeof(cameraBlock));
+	cameraUBO->bind();
+	objectUBO->beginFrame();
+	
+	// Draw origin frame, grid and spline (--no-lines leaves them out, as the
+	// software renderer does)
+	if(linesEnabled) {
+		profiler->begin(profGrid);
+		progSimple->bind();
+		objectUBO->push(glm::value_ptr(M->topMatrix()), sizeof(glm::mat4));
+		GLState::lineWidth(2);
+		glBegin(GL_LINES);
+		glColor3f(1, 0, 0);
+		glVertex3f(0, 0, 0);
+		glVertex3f(1, 0, 0);
+		glColor3f(0, 1, 0);
+		glVertex3f(0, 0, 0);
+		glVertex3f(0, 1, 0);
+		glColor3f(0, 0, 1);
+		glVertex3f(0, 0, 0);
+		glVertex3f(0, 0, 1);
+		glEnd();
 
-	if (keyToggles[(unsigned)' ']) {  // you can click 'v' in order to change between two different lookAt() views
-		if (keyToggles[(unsigned)'v'])
-			camera->applyLookAtMatrix(MV, helicopter_matrix, 0, 0, 0.1);
-		else
-			camera->applyLookAtMatrix(MV, helicopter_matrix, 0, 0, -5);
-	} 
-	else
-		camera->applyViewMatrix(MV);
-	
-	// Draw origin frame
-	progSimple->bind();
-	glUniformMatrix4fv(progSimple->getUniform("P"), 1, GL_FALSE, glm::value_ptr(P->topMatrix()));
-	glUniformMatrix4fv(progSimple->getUniform("MV"), 1, GL_FALSE, glm::value_ptr(MV->topMatrix()));
-	glLineWidth(2);
-	glBegin(GL_LINES);
-	glColor3f(1, 0, 0);
-	glVertex3f(0, 0, 0);
-	glVertex3f(1, 0, 0);
-	glColor3f(0, 1, 0);
-	glVertex3f(0, 0, 0);
-	glVertex3f(0, 1, 0);
-	glColor3f(0, 0, 1);
-	glVertex3f(0, 0, 0);
-	glVertex3f(0, 0, 1);
-	glEnd();
+		// Draw grid
+		glColor3f(0.66, 0.66, 0.66);
+		GLState::lineWidth(2);
+		glBegin(GL_LINES);
+		for (int i = -10; i < 10; i++) {
+			glVertex3f(i, 0, -10);
+			glVertex3f(i, 0, 10);
+			glVertex3f(-10, 0, i);
+			glVertex3f(10, 0, i);
+		}
+		glEnd();
+		progSimple->unbind();
+		profiler->end(profGrid);
 
-	// Draw grid
-	glUniformMatrix4fv(progSimple->getUniform("P"), 1, GL_FALSE, glm::value_ptr(P->topMatrix()));
-	glUniformMatrix4fv(progSimple->getUniform("MV"), 1, GL_FALSE, glm::value_ptr(MV->topMatrix()));
-	glColor3f(0.66, 0.66, 0.66);
-	glLineWidth(2);
-	glBegin(GL_LINES);
-	for (int i = -10; i < 10; i++) {
-		glVertex3f(i, 0, -10);
-		glVertex3f(i, 0, 10);
-		glVertex3f(-10, 0, i);
-		glVertex3f(10, 0, i);
+		if (keyToggles[(unsigned)'k']) {
+			profiler->begin(profSpline);
+			progSimple->bind();
+			catmull_rom_spline();
+			progSimple->unbind();
+			profiler->end(profSpline);
+		}
 	}
-	glEnd();
-	progSimple->unbind();
 
-	if (keyToggles[(unsigned)'k']) {
-		progSimple->bind();
-		catmull_rom_spline();
-		progSimple->unbind();
+	GLSL::checkError(GET_FILE_LINE);
+	
+	// Draw the Helicopters
+	M->pushMatrix();
+	helicopter->propRotate(true);
+	profiler->begin(profHelicopter);
+	interpolate(progNormal, M, renderQueue->getList(0), *sim, time);
+	profiler->end(profHelicopter);
+	if (keyToggles[(unsigned)'k'] || keyToggles[(unsigned)'K']) {
+		profiler->begin(profKeyframes);
+		// Each worker composes its keyframes' transforms into its own list,
+		// with one matrix stack per range
+		glm::mat4 root = M->topMatrix();
+		jobs->parallelFor((int)keyframes.size(), KEYFRAME_GRAIN, [&](int worker, int begin, int end) {
+			TraceScope trace("keyframes");
+			auto MW = make_shared<MatrixStack>();
+			MW->multMatrix(root);
+			CommandList &list = renderQueue->getList(worker);
+			for (int i = begin; i < end; i++) {
+				// After the helicopter, in keyframe order on any thread
+				list.setOrder(1 + i);
+				keyframes[i].drawKeyFrame(progNormal, MW, list, time);
+			}
+		});
+		profiler->end(profKeyframes);
+	}
+	M->popMatrix();
+	
+	profiler->begin(profQueue);
+	renderQueue->flush();
+	profiler->end(profQueue);
+	
+	if(fleet) {
+		profiler->begin(profFleet);
+		fleet->draw(progInstanced, *helicopter, objectUBO, time, P->topMatrix()*V->topMatrix(), sim->fleet);
+		profiler->end(profFleet);
 	}
 
+	// Pop stacks
+	V->popMatrix();
+	P->popMatrix();
+	
 	GLSL::checkError(GET_FILE_LINE);
+}
+
+// The frame of render() for the software renderer: only the meshes, no grid
+// or spline lines
+static void renderSoftware(SoftRenderer &soft, CommandList &list, const FrameTime &time)
+{
+	simulate(time.t, time.dt, frameState);
 	
-	// Draw the Helicopters
-	progNormal->bind();
-	// Send projection matrix (same for all helicopters)
-	glUniformMatrix4fv(progNormal->getUniform("P"), 1, GL_FALSE, glm::value_ptr(P->topMatrix()));
+	auto P = make_shared<MatrixStack>();
+	auto V = make_shared<MatrixStack>();
+	auto M = make_shared<MatrixStack>();
+	applyCamera((float)soft.getWidth()/(float)soft.getHeight(), P, V);
+	pickP = P->topMatrix();
+	pickV = V->topMatrix();
+	pickWidth = soft.getWidth();
+	pickHeight = soft.getHeight();
+	soft.setCamera(P->topMatrix(), V->topMatrix());
+	soft.clear(glm::vec3(1.0f, 1.0f, 1.0f));
 	
-	MV->pushMatrix();
+	list.setState(keyToggles[(unsigned)'c'] ? RenderQueue::CULL : 0);
 	helicopter->propRotate(true);
-	interpolate(progNormal, MV, u);
+	interpolate(progNormal, M, list, frameState, time);
 	if (keyToggles[(unsigned)'k'] || keyToggles[(unsigned)'K']) {
-		
-		for (int i = 0; i < keyframes.size(); i++) {
-			keyframes[i].drawKeyFrame(progNormal, MV);
+		for (int i = 0; i < (int)keyframes.size(); i++) {
+			keyframes[i].drawKeyFrame(progNormal, M, list, time);
 		}
 	}
-	MV->popMatrix();
+	soft.draw(list);
+	list.clear();
+	soft.finish();
+	
+	V->popMatrix();
+	P->popMatrix();
+}
 
-	progNormal->unbind();
+// Renders the animation on the CPU, without any GL context.
+static int runSoftware(int nframes, int width, int height, const string &outName)
+{
+	jobs = make_shared<JobSystem>(jobThreads);
+	helicopter = make_shared<Helicopter>();
+	helicopter->load(jobs, RESOURCE_DIR, "helicopter_body1.obj", "helicopter_body2.obj", "helicopter_prop1.obj", "helicopter_prop2.obj");
+	for (int i = 0; i < (int)keyframes.size(); i++) {
+		keyframes[i].setHelicopter(helicopter);
+	}
+	initPicker();
+	camera = make_shared<Camera>();
+	keyToggles[(unsigned)'c'] = true;
+	// Never built; it only tags the draws
+	progNormal = make_shared<Program>();
+	
+	SoftRenderer soft;
+	soft.init(width, height, jobs);
+	CommandList list;
+	auto start = chrono::steady_clock::now();
+	for(int i = 0; i < nframes; ++i) {
+		const FrameTime &time = frameClock->tick();
+		if(isReplaying()) {
+			replayInput(time);
+		}
+		renderSoftware(soft, list, time);
+	}
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cout << nframes << " frames in " << elapsed << " s (" << 1000.0*elapsed/nframes << " ms/frame, "
+	     << nframes/elapsed << " fps) on the CPU with " << jobs->getCount() << " threads" << endl;
+	if(Trace::isEnabled()) {
+		Trace::write(traceName);
+	}
+	if(!outName.empty() && !soft.writePPM(outName)) {
+		return -1;
+	}
+	return 0;
+}
 
-	// Pop stacks
-	MV->popMatrix();
-	P->popMatrix();
+static bool initGLEW()
+{
+	glewExperimental = true;
+	GLenum rc = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	// GLEW built for GLX loads the GL entry points before it looks for a GLX
+	// display, so this is harmless with a headless EGL context.
+	if(rc == GLEW_ERROR_NO_GLX_DISPLAY && !window) {
+		rc = GLEW_OK;
+	}
+#endif
+	if(rc != GLEW_OK) {
+		cerr << "Failed to initialize GLEW" << endl;
+		return false;
+	}
+	glGetError(); // A bug in glewInit() causes an error that we can safely ignore.
+	cout << "OpenGL version: " << glGetString(GL_VERSION) << endl;
+	cout << "GLSL version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
+	return true;
+}
+
+// Renders the frame at time through the software renderer and compares it
+// with the GL frame in the headless framebuffer, channel by channel
+static bool compareSoftware(const FrameTime &time, int tolerance)
+{
+	vector<unsigned char> pixelsGL;
+	headless->readPixels(pixelsGL);
+	SoftRenderer soft;
+	soft.init(headless->getWidth(), headless->getHeight(), jobs);
+	CommandList list;
+	renderSoftware(soft, list, time);
+	const vector<unsigned char> &pixelsSoft = soft.getPixels();
 	
-	GLSL::checkError(GET_FILE_LINE);
+	size_t pixels = pixelsGL.size()/3;
+	size_t off = 0;
+	int largest = 0;
+	for(size_t i = 0; i < pixels; ++i) {
+		int diff = 0;
+		for(int c = 0; c < 3; ++c) {
+			diff = max(diff, abs((int)pixelsGL[3*i + c] - (int)pixelsSoft[3*i + c]));
+		}
+		largest = max(largest, diff);
+		if(diff > tolerance) {
+			++off;
+		}
+	}
+	bool match = off <= COMPARE_MAX_OFF*pixels;
+	cout << "GL vs software: " << off << " of " << pixels << " pixels differ by more than " << tolerance
+	     << " (largest difference " << largest << "): " << (match ? "match" : "MISMATCH") << endl;
+	return match;
+}
+
+// Frees the streamed buffers while their context is still current
+static void releaseGL()
+{
+	fleet.reset();
+	renderQueue.reset();
+	objectUBO.reset();
+	cameraUBO.reset();
+}
+
+// Renders the animation offscreen, as fast as possible.
+static int runHeadless(int nframes, int width, int height, const string &outName, int compareTolerance)
+{
+	headless = make_shared<Headless>();
+	if(!headless->initContext() || !initGLEW() || !headless->initFramebuffer(width, height)) {
+		return -1;
+	}
+	headless->bind();
+	init();
+	auto start = chrono::steady_clock::now();
+	FrameTime last;
+	for(int i = 0; i < nframes; ++i) {
+		const FrameTime &time = frameClock->tick();
+		if(isReplaying()) {
+			replayInput(time);
+		}
+		render(time);
+		profiler->endFrame();
+		last = time;
+	}
+	glFinish();
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cout << nframes << " frames in " << elapsed << " s (" << 1000.0*elapsed/nframes << " ms/frame, "
+	     << nframes/elapsed << " fps)" << endl;
+	profiler->print();
+	GLState::printCounters();
+	renderQueue->printStats();
+	if(fleet) {
+		fleet->printStats();
+	}
+	if(!profileName.empty()) {
+		profiler->writeJSON(profileName);
+	}
+	if(Trace::isEnabled()) {
+		Trace::write(traceName);
+	}
+	bool match = compareTolerance < 0 || compareSoftware(last, compareTolerance);
+	releaseGL();
+	if(!outName.empty() && !headless->writePPM(outName)) {
+		return -1;
+	}
+	headless.reset();
+	return match ? 0 : -1;
 }
 
 int main(int argc, char **argv)
 {
 	if(argc < 2) {
 		cout << "Please specify the resource directory." << endl;
+		cout << "Usage: " << argv[0] << " RESOURCE_DIR [--headless FRAMES] [--dt SECONDS] [--script FILE] [--size WIDTH HEIGHT] [--out FILE.ppm] [--profile FILE.json] [--trace FILE.json] [--threads N] [--fleet N] [--bake FILE SECONDS] [--play FILE] [--easing FILE] [--sim HZ] [--no-indirect] [--no-cull] [--no-lines] [--soft] [--compare-soft TOLERANCE] [--record FILE] [--replay FILE]" << endl;
 		return 0;
 	}
 	RESOURCE_DIR = argv[1] + string("/");
 	
+	// Optional headless mode and animation clock. The clock runs in real
+	// time unless a fixed step or a script of frame times is given; headless
+	// runs default to a fixed 60 Hz step.
+	frameClock = make_shared<FrameClock>();
+	int headlessFrames = 0;
+	double dt = 0.0;
+	string scriptName;
+	int width = 640;
+	int height = 480;
+	bool sizeGiven = false;
+	string outName;
+	string bakeName;
+	double bakeSeconds = 0.0;
+	string playName;
+	string recordName;
+	string replayName;
+	bool soft = false;
+	int compareTolerance = -1;
+	easing = make_shared<Easing>(Easing::preset(Easing::EASE_IN_OUT));
+	for(int i = 2; i < argc; ++i) {
+		if(strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+			headlessFrames = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--dt") == 0 && i + 1 < argc) {
+			dt = atof(argv[++i]);
+		} else if(strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+			scriptName = argv[++i];
+		} else if(strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+			width = atoi(argv[++i]);
+			height = atoi(argv[++i]);
+			sizeGiven = true;
+		} else if(strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+			outName = argv[++i];
+		} else if(strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+			profileName = argv[++i];
+		} else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			traceName = argv[++i];
+			Trace::setEnabled(true);
+		} else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			jobThreads = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--fleet") == 0 && i + 1 < argc) {
+			fleetSize = min(max(atoi(argv[++i]), 0), (int)Fleet::MAX_SIZE);
+		} else if(strcmp(argv[i], "--bake") == 0 && i + 2 < argc) {
+			bakeName = argv[++i];
+			bakeSeconds = atof(argv[++i]);
+		} else if(strcmp(argv[i], "--play") == 0 && i + 1 < argc) {
+			playName = argv[++i];
+		} else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			recordName = argv[++i];
+		} else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replayName = argv[++i];
+		} else if(strcmp(argv[i], "--soft") == 0) {
+			soft = true;
+		} else if(strcmp(argv[i], "--compare-soft") == 0 && i + 1 < argc) {
+			compareTolerance = max(atoi(argv[++i]), 0);
+		} else if(strcmp(argv[i], "--no-lines") == 0) {
+			linesEnabled = false;
+		} else if(strcmp(argv[i], "--no-cull") == 0) {
+			cullEnabled = false;
+		} else if(strcmp(argv[i], "--no-indirect") == 0) {
+			indirectEnabled = false;
+		} else if(strcmp(argv[i], "--sim") == 0 && i + 1 < argc) {
+			simRate = atof(argv[++i]);
+		} else if(strcmp(argv[i], "--easing") == 0 && i + 1 < argc) {
+			if(!easing->loadControlPoints(argv[++i])) {
+				return -1;
+			}
+		} else {
+			cerr << "Unknown option " << argv[i] << endl;
+			return -1;
+		}
+	}
+	
+	initPath();
+	// Offline: sample the path into a pose track and exit. Playback wraps at
+	// the track's end, so it holds whole loops of the path.
+	if(!bakeName.empty()) {
+		if(bakeSeconds > 0.0) {
+			double seconds = ceil(bakeSeconds/PATH_PERIOD - 1e-9)*PATH_PERIOD;
+			if(seconds != bakeSeconds) {
+				cout << "Baking " << seconds << " s, a whole number of " << PATH_PERIOD << " s path loops" << endl;
+				bakeSeconds = seconds;
+			}
+		}
+		bool ok = PoseTrack::bake(bakeName, bakeSeconds, BAKE_RATE, [](double t, glm::vec3 &p, glm::quat &q) {
+			pathPose(t, NULL, p, q);
+		});
+		return ok ? 0 : -1;
+	}
+	if(!playName.empty()) {
+		poseTrack = make_shared<PoseTrack>();
+		if(!poseTrack->open(playName)) {
+			return -1;
+		}
+	}
+	
+	// A replayed session runs at the window size and frame times it was
+	// recorded with, unless they are given
+	if(!replayName.empty()) {
+		inputLog = make_shared<InputLog>();
+		if(!inputLog->startReplay(replayName)) {
+			return -1;
+		}
+		if(!sizeGiven) {
+			width = inputLog->getWidth();
+			height = inputLog->getHeight();
+		}
+	}
+	
+	if(!scriptName.empty()) {
+		if(!frameClock->loadScript(scriptName)) {
+			return -1;
+		}
+	} else if(dt > 0.0) {
+		frameClock->setFixedStep(dt);
+	} else if(inputLog) {
+		frameClock->setScript(inputLog->getFrameTimes());
+	} else if(headlessFrames > 0) {
+		frameClock->setFixedStep(1.0/60.0);
+	}
+	if(headlessFrames > 0) {
+		// Headless runs animate in the frame, so they stay reproducible
+		if(simRate > 0.0) {
+			cout << "Ignoring --sim in headless mode" << endl;
+		}
+		if(!recordName.empty()) {
+			cout << "Ignoring --record in headless mode" << endl;
+		}
+		if(soft) {
+			if(fleetSize > 0) {
+				cout << "Ignoring --fleet with --soft" << endl;
+			}
+			return runSoftware(headlessFrames, width, height, outName);
+		}
+		if(compareTolerance >= 0) {
+			// Only what both renderers draw
+			linesEnabled = false;
+			if(fleetSize > 0) {
+				cout << "Ignoring --fleet with --compare-soft" << endl;
+				fleetSize = 0;
+			}
+		}
+		return runHeadless(headlessFrames, width, height, outName, compareTolerance);
+	}
+	
 	// Set error callback.
 	glfwSetErrorCallback(error_callback);
 	// Initialize the library.
@@ -430,7 +1052,10 @@ int main(int argc, char **argv)
 		return -1;
 	}
 	// Create a windowed mode window and its OpenGL context.
-	window = glfwCreateWindow(640, 480, "YOUR NAME", NULL, NULL);
+#if GLSL_CHECK_ERRORS
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+#endif
+	window = glfwCreateWindow(width, height, "YOUR NAME", NULL, NULL);
 	if(!window) {
 		glfwTerminate();
 		return -1;
@@ -438,16 +1063,20 @@ int main(int argc, char **argv)
 	// Make the window's context current.
 	glfwMakeContextCurrent(window);
 	// Initialize GLEW.
-	glewExperimental = true;
-	if(glewInit() != GLEW_OK) {
-		cerr << "Failed to initialize GLEW" << endl;
+	if(!initGLEW()) {
 		return -1;
 	}
-	glGetError(); // A bug in glewInit() causes an error that we can safely ignore.
-	cout << "OpenGL version: " << glGetString(GL_VERSION) << endl;
-	cout << "GLSL version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
 	// Set vsync.
 	glfwSwapInterval(1);
+	// Record input from here on; replays ignore it.
+	if(!recordName.empty() && !inputLog) {
+		int w, h;
+		glfwGetWindowSize(window, &w, &h);
+		inputLog = make_shared<InputLog>();
+		if(!inputLog->startRecording(recordName, w, h)) {
+			return -1;
+		}
+	}
 	// Set keyboard callback.
 	glfwSetKeyCallback(window, key_callback);
 	// Set char callback.
@@ -458,16 +1087,60 @@ int main(int argc, char **argv)
 	glfwSetMouseButtonCallback(window, mouse_button_callback);
 	// Initialize scene.
 	init();
-	// Loop until the user closes the window.
+	// Animate at a fixed rate on its own thread, independent of vsync.
+	// Recorded sessions animate in the frame, with the recorded times.
+	if(simRate > 0.0 && inputLog) {
+		cout << "Ignoring --sim while recording or replaying input" << endl;
+		simRate = 0.0;
+	}
+	if(simRate > 0.0) {
+		simulation = make_shared<Simulation>();
+		simulation->start(simRate, jobs, simulate);
+	}
+	// Loop until the user closes the window (or the replayed session ends).
+	auto start = chrono::steady_clock::now();
+	long nframes = 0;
 	while(!glfwWindowShouldClose(window)) {
+		// Pick up edited shaders between frames.
+		shaderWatcher->update();
+		const FrameTime &time = frameClock->tick();
+		if(isReplaying()) {
+			if(inputLog->isFinished(time.frame)) {
+				break;
+			}
+			replayInput(time);
+		} else if(inputLog) {
+			// Input polled after this frame is recorded for the next one
+			inputLog->beginFrame(time);
+		}
 		// Render scene.
-		render();
+		render(time);
+		profiler->endFrame();
+		++nframes;
 		// Swap front and back buffers.
 		glfwSwapBuffers(window);
 		// Poll for and process events.
 		glfwPollEvents();
 	}
+	if(isReplaying() && nframes > 0) {
+		double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		cout << "Replayed " << nframes << " frames in " << elapsed << " s (" << 1000.0*elapsed/nframes << " ms/frame)" << endl;
+		profiler->print();
+	}
+	if(inputLog) {
+		inputLog->close();
+	}
+	if(simulation) {
+		simulation->stop();
+	}
+	if(!profileName.empty()) {
+		profiler->writeJSON(profileName);
+	}
+	if(Trace::isEnabled()) {
+		Trace::write(traceName);
+	}
 	// Quit program.
+	releaseGL();
 	glfwDestroyWindow(window);
 	glfwTerminate();
 	return 0;